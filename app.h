@@ -41,6 +41,7 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
 
 typedef enum app_state_t { APP_STATE_EXIT_REQUESTED, APP_STATE_NORMAL, } app_state_t;
 app_state_t app_yield( app_t* app );
+app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound );
 void app_cancel_exit( app_t* app );
 
 void app_title( app_t* app, char const* title );
@@ -93,11 +94,41 @@ typedef struct app_displays_t { app_display_t* displays; int count; } app_displa
 app_displays_t app_displays( app_t* app );
 
 void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr );
+void app_present_rows( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, 
+    APP_U32 border_xbgr, int first_row, int row_count );
 
 void app_sound( app_t* app, int sample_pairs_count, 
     void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data );
+void app_sound_f( app_t* app, int sample_pairs_count, 
+    void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data );
 void app_sound_volume( app_t* app, float volume );
 
+typedef enum app_sound_format_t { APP_SOUND_FORMAT_S16, APP_SOUND_FORMAT_S32, APP_SOUND_FORMAT_FLOAT, } app_sound_format_t;
+
+typedef struct app_sound_params_t
+    {
+    app_sound_format_t format;
+    int sample_rate;
+    int buffer_size;
+    int period_size;
+    int period_count;
+    int latency_us;
+    } app_sound_params_t;
+
+void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count );
+app_sound_params_t app_sound_params( app_t* app );
+
+typedef struct app_sound_stats_t
+    {
+    int underruns;
+    int recoveries;
+    int late_refills;
+    int min_headroom;
+    } app_sound_stats_t;
+
+app_sound_stats_t app_sound_stats( app_t* app );
+void app_sound_stats_reset( app_t* app );
+
 typedef enum app_key_t { APP_KEY_INVALID, APP_KEY_LBUTTON, APP_KEY_RBUTTON, APP_KEY_CANCEL, APP_KEY_MBUTTON, 
     APP_KEY_XBUTTON1, APP_KEY_XBUTTON2, APP_KEY_BACK, APP_KEY_TAB, APP_KEY_CLEAR, APP_KEY_RETURN, APP_KEY_SHIFT, 
     APP_KEY_CONTROL, APP_KEY_MENU, APP_KEY_PAUSE, APP_KEY_CAPITAL, APP_KEY_KANA, APP_KEY_HANGUL = APP_KEY_KANA, 
@@ -329,6 +360,19 @@ the user have requested the app to terminate, e.g. by pressing the *close* butto
 should exit. In the case of `APP_STATE_NORMAL`, there is no need to do anything.
 
 
+app_wait
+--------
+
+    app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound )
+
+Does the same as `app_yield`, but first puts the calling thread to sleep until there is something to respond to: input
+or other window activity, `timeout_ms` milliseconds passing (-1 to wait for as long as it takes, 0 to not wait at all)
+or, if `wake_on_sound` is non-zero, the sound thread having rendered another period. Use it instead of `app_yield` to
+only redraw when there is something new to show, rather than on every display refresh, which keeps an idle app from
+using any CPU. Where there is no way to wait for the window and the sound together (currently on Mac OS X), it behaves
+just like `app_yield`.
+
+
 app_cancel_exit
 ---------------
 
@@ -587,6 +631,21 @@ drawing using opengl calls. In this case `app_present` will work as a call to Sw
 will be automatically called whenever the window is resized.
 
 
+app_present_rows
+----------------
+
+    void app_present_rows( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, 
+        APP_U32 border_xbgr, int first_row, int row_count )
+
+Works like `app_present`, for when you know which part of the bitmap has changed since the last call. Only the rows 
+from `first_row` to `first_row + row_count` are copied to the texture that gets displayed, the rest of it is kept from 
+before. Pass a `row_count` of 0 when nothing has changed, to just display the last bitmap again. The whole bitmap is 
+still needed, and is used in full when its size has changed since the last call.
+
+On OpenGL 2.1 and later, the changed rows go through a pair of pixel buffer objects, used alternately, so the copy to 
+the texture doesn't have to wait for the GPU to be done with the previous one.
+
+
 app_sound_buffer_size
 ---------------------
 
@@ -637,6 +696,88 @@ app_sound_volume
 Sets the output volume level of the sound stream, as a normalized linear value in the range 0.0f to 1.0f, inclusive.
 
 
+app_sound_latency
+-----------------
+
+    void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count )
+
+Requests how the sound device should be set up: `latency_us` is the total size of the device buffer in microseconds, 
+`period_size` the number of sample pairs the device consumes between each time it asks for more, and `period_count`
+the number of periods in the buffer. Any of them can be 0 to leave it up to the device (or, for the buffer, to the 
+`sample_pairs_count` given to `app_sound`). The device is reconfigured straight away, restarting playback if needed, 
+and will only get as close to the requested values as the hardware allows - call `app_sound_params` to find out what
+was actually negotiated. Currently only supported on Linux, and ignored on other platforms.
+
+
+app_sound_params
+----------------
+
+    app_sound_params_t app_sound_params( app_t* app )
+
+Returns the parameters of the sound device as they currently are: the sample `format` of the device, `sample_rate` in 
+hz, `buffer_size` and `period_size` in sample pairs, `period_count`, and `latency_us`, the time it takes to play 
+through the full buffer. The sample rate is the one the device runs at, which might not be 44100hz, and the sound 
+callback should produce samples at that rate. The parameters don't change while the sound callback is running, so it 
+is safe to call `app_sound_params` from within the callback.
+
+
+app_sound_stats
+---------------
+
+    app_sound_stats_t app_sound_stats( app_t* app )
+    void app_sound_stats_reset( app_t* app )
+
+Returns counters for how well the sound device has been kept fed since playback started, or since the last call to 
+`app_sound_stats_reset`:
+* underruns - the number of times the device ran out of samples and had to stop.
+* recoveries - the number of times the device was successfully restarted after an underrun or a system suspend.
+* late_refills - the number of times the device had already played through more than one period when more sound was
+    sent to it, which is a sign the buffer is close to being too small.
+* min_headroom - the fewest sample pairs that were left queued in the device when it was refilled, or -1 if not 
+    measured yet. 
+Counters can be read at any time, from any thread. Currently only collected on Linux, other platforms return zeros.
+
+
+app_sound_f
+-----------
+
+    void app_sound_f( app_t* app, int sample_pairs_count, 
+        void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+
+Works like `app_sound`, but the callback produces samples as floats in the range -1.0f to 1.0f. Where the sound device
+can take float (or 32-bit) samples it is set up to do so, and the callback writes straight into the device buffer,
+keeping the full precision of the samples. Otherwise they are converted to 16-bit, clamping anything out of range.
+
+
+Headless sound
+--------------
+
+When built with `APP_NULL`, app.h normally does nothing at all. Also defining `APP_NULL_SOUND` (which needs pthreads)
+gives it a sound device that doesn't need any hardware, so the whole playback path can be run and timed on machines
+without a sound card. It runs the sound callbacks from a thread just like the real backends, negotiates float samples 
+for `app_sound_f`, and reports `app_sound_params` and `app_sound_stats` the same way. It is configured with defines:
+* APP_NULL_SOUND_FILE - where to write the sound, as raw interleaved samples: a file name, a named pipe, or "-" for 
+    stdout. Defaults to NULL, which throws the sound away.
+* APP_NULL_SOUND_REALTIME - 1 (the default) to play the sound at the speed a real device would, 0 to take it as fast 
+    as it can be produced.
+* APP_NULL_RUN_MS - how long `app_yield` and `app_wait` keep returning APP_STATE_NORMAL before asking the app to exit. While sound
+    is playing, the sound thread renders exactly APP_NULL_RUN_MS worth of sound and the run ends once that has been 
+    played, so every run produces the same amount of sound in either mode. Defaults to 0.
+
+
+X11 without OpenGL
+------------------
+
+On Linux, defining `APP_X11_SHM` makes `app_present` put the bitmap to the window with MIT-SHM instead of drawing it 
+with OpenGL, so there's no need for GLX, and nothing slow when the only GL available is a software one, like on
+machines without a GPU or a remote X server. The bitmap is scaled by whole pixels on the CPU into an image the size of 
+the window, which the X server reads straight out of shared memory, and only the rows passed to `app_present_rows` are 
+scaled and put to the window. When the server can't share memory with the program (it's on another machine), the 
+image is sent over the connection with XPutImage instead. Link with -lXext rather than -lGL. In this mode, 
+`app_interpolation` is always APP_INTERPOLATION_NONE, as the image is only ever scaled by whole pixels, and the window 
+must use a visual with 8 bits per channel in 32 bit pixels, which is what any modern X server gives by default.
+
+
 app_input
 ---------
 
@@ -726,7 +867,7 @@ details.
 //    OPENGL CODE - Shared between platform implementations
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#ifndef APP_NULL
+#if !defined( APP_NULL ) && !( defined( APP_LINUX_X11 ) && defined( APP_X11_SHM ) )
 
 #if defined( APP_WINDOWS )
     #define _CRT_NONSTDC_NO_DEPRECATE 
@@ -741,6 +882,7 @@ details.
     typedef char APP_GLchar;
     typedef unsigned char APP_GLboolean;
     typedef size_t APP_GLsizeiptr;
+    typedef ptrdiff_t APP_GLintptr;
     typedef unsigned int APP_GLbitfield;
 #elif defined( APP_MACOS )
     #define _CRT_NONSTDC_NO_DEPRECATE
@@ -757,6 +899,7 @@ details.
     typedef GLchar APP_GLchar;
     typedef GLboolean APP_GLboolean;
     typedef GLsizeiptr APP_GLsizeiptr;
+    typedef GLintptr APP_GLintptr;
     typedef GLbitfield APP_GLbitfield;
 #elif defined( APP_LINUX_X11 )
     #define _CRT_NONSTDC_NO_DEPRECATE
@@ -773,6 +916,7 @@ details.
     typedef GLchar APP_GLchar;
     typedef GLboolean APP_GLboolean;
     typedef GLsizeiptr APP_GLsizeiptr;
+    typedef GLintptr APP_GLintptr;
     typedef GLbitfield APP_GLbitfield;
 #else
     #error Undefined platform. Define APP_WINDOWS, APP_MACOS, APP_LINUX_X11 or APP_NULL.
@@ -785,6 +929,7 @@ details.
     typedef int APP_GLchar;
     typedef int APP_GLboolean;
     typedef int APP_GLsizeiptr;
+    typedef int APP_GLintptr;
     typedef int APP_GLbitfield;
 #endif
 
@@ -807,6 +952,8 @@ details.
 #define APP_GL_UNSIGNED_BYTE 0x1401
 #define APP_GL_COLOR_BUFFER_BIT 0x00004000
 #define APP_GL_TRIANGLE_FAN 0x0006
+#define APP_GL_PIXEL_UNPACK_BUFFER 0x88ec
+#define APP_GL_STREAM_DRAW 0x88e0
 
 struct app_internal_opengl_t
     {
@@ -838,6 +985,8 @@ struct app_internal_opengl_t
     void (APP_GLCALLTYPE* glUniform3f) (APP_GLint location, APP_GLfloat v0, APP_GLfloat v1, APP_GLfloat v2);
     APP_GLint (APP_GLCALLTYPE* glGetUniformLocation) (APP_GLuint program, APP_GLchar const* name);
     void (APP_GLCALLTYPE* glTexImage2D) (APP_GLenum target, APP_GLint level, APP_GLint internalformat, APP_GLsizei width, APP_GLsizei height, APP_GLint border, APP_GLenum format, APP_GLenum type, void const* pixels);
+    void (APP_GLCALLTYPE* glTexSubImage2D) (APP_GLenum target, APP_GLint level, APP_GLint xoffset, APP_GLint yoffset, APP_GLsizei width, APP_GLsizei height, APP_GLenum format, APP_GLenum type, void const* pixels);
+    void (APP_GLCALLTYPE* glBufferSubData) (APP_GLenum target, APP_GLintptr offset, APP_GLsizeiptr size, void const* data);
     void (APP_GLCALLTYPE* glClearColor) (APP_GLfloat red, APP_GLfloat green, APP_GLfloat blue, APP_GLfloat alpha);
     void (APP_GLCALLTYPE* glClear) (APP_GLbitfield mask);
     void (APP_GLCALLTYPE* glDrawArrays) (APP_GLenum mode, APP_GLint first, APP_GLsizei count);
@@ -856,6 +1005,14 @@ struct app_internal_opengl_t
     APP_GLuint vertexarray;
     APP_GLuint texture;
     APP_GLuint shader;
+    APP_GLint modulate_location;
+
+    // size the texture storage was last allocated with, 0 until the first present
+    int texture_width;
+    int texture_height;
+    // changed rows are uploaded through these in turn, both 0 if pixel buffer objects are not supported
+    APP_GLuint pixelbuffers[ 2 ];
+    int pixelbuffer_index;
 };
 
 
@@ -1005,6 +1162,11 @@ static int app_internal_opengl_init( app_t* app, struct app_internal_opengl_t* g
     gl->glDeleteShader( fs );
     gl->glDeleteShader( vs );
 
+    // the sampler is always unit 0, and only the modulate color changes between frames
+    gl->glUseProgram( prg );
+    gl->glUniform1i( gl->glGetUniformLocation( prg, "tex" ), 0 );
+    gl->modulate_location = gl->glGetUniformLocation( prg, "modulate" );
+
     gl->glGenBuffers( 1, &gl->vertexbuffer );
     gl->glGenVertexArrays( 1, &gl->vertexarray );
     gl->glBindVertexArray( gl->vertexarray );
@@ -1018,6 +1180,15 @@ static int app_internal_opengl_init( app_t* app, struct app_internal_opengl_t* g
     gl->glBindTexture( APP_GL_TEXTURE_2D, gl->texture );
     gl->glTexParameteri( APP_GL_TEXTURE_2D, APP_GL_TEXTURE_MIN_FILTER, APP_GL_NEAREST );
     gl->glTexParameteri( APP_GL_TEXTURE_2D, APP_GL_TEXTURE_MAG_FILTER, APP_GL_NEAREST );
+    gl->texture_width = 0;
+    gl->texture_height = 0;
+
+    // pixel buffer objects are core from 2.1
+    gl->pixelbuffers[ 0 ] = 0;
+    gl->pixelbuffers[ 1 ] = 0;
+    gl->pixelbuffer_index = 0;
+    if( gl->glTexSubImage2D && gl->glBufferSubData && ( versionStr[ 0 ] > '2' || versionStr[ 2 ] >= '1' ) )
+        gl->glGenBuffers( 2, gl->pixelbuffers );
 
     return 1;
     }
@@ -1028,12 +1199,13 @@ static int app_internal_opengl_term( struct app_internal_opengl_t* gl )
     gl->glDeleteProgram( gl->shader );
     gl->glDeleteBuffers( 1, &gl->vertexbuffer); 
     gl->glDeleteTextures( 1, &gl->texture ); 
+    if( gl->pixelbuffers[ 0 ] ) gl->glDeleteBuffers( 2, gl->pixelbuffers );
     return 1;
     }
 
 
 static int app_internal_opengl_present( struct app_internal_opengl_t* gl, APP_U32 const* pixels_xbgr, int width, 
-    int height, APP_U32 mod_xbgr, APP_U32 border_xbgr )
+    int height, APP_U32 mod_xbgr, APP_U32 border_xbgr, int first_row, int row_count )
     {
     float x1 = 0.0f, y1 = 0.0f, x2 = (float) gl->window_width, y2 = (float) gl->window_height;
 
@@ -1100,12 +1272,51 @@ static int app_internal_opengl_present( struct app_internal_opengl_t* gl, APP_U3
     float mod_b = ( ( mod_xbgr       ) & 0xff ) / 255.0f;
 
     gl->glUseProgram( gl->shader );
-    gl->glUniform1i( gl->glGetUniformLocation( gl->shader, "tex" ), 0 );
-    gl->glUniform3f( gl->glGetUniformLocation( gl->shader, "modulate" ), mod_r, mod_g, mod_b );
+    gl->glUniform3f( gl->modulate_location, mod_r, mod_g, mod_b );
 
     gl->glActiveTexture( APP_GL_TEXTURE0 );
     gl->glBindTexture( APP_GL_TEXTURE_2D, gl->texture );
-    gl->glTexImage2D( APP_GL_TEXTURE_2D, 0, APP_GL_RGBA, width, height, 0, APP_GL_RGBA, APP_GL_UNSIGNED_BYTE, pixels_xbgr ); 
+    if( width != gl->texture_width || height != gl->texture_height || !gl->glTexSubImage2D )
+        {
+        // new storage, with all of the bitmap in it
+        gl->glTexImage2D( APP_GL_TEXTURE_2D, 0, APP_GL_RGBA, width, height, 0, APP_GL_RGBA, APP_GL_UNSIGNED_BYTE, pixels_xbgr ); 
+        gl->texture_width = width;
+        gl->texture_height = height;
+        if( gl->pixelbuffers[ 0 ] )
+            {
+            for( int i = 0; i < 2; ++i )
+                {
+                gl->glBindBuffer( APP_GL_PIXEL_UNPACK_BUFFER, gl->pixelbuffers[ i ] );
+                gl->glBufferData( APP_GL_PIXEL_UNPACK_BUFFER, width * height * sizeof( APP_U32 ), NULL, APP_GL_STREAM_DRAW );
+                }
+            gl->glBindBuffer( APP_GL_PIXEL_UNPACK_BUFFER, 0 );
+            }
+        }
+    else
+        {
+        if( first_row < 0 ) { row_count += first_row; first_row = 0; }
+        if( first_row + row_count > height ) row_count = height - first_row;
+        if( row_count > 0 )
+            {
+            APP_U32 const* rows = pixels_xbgr + first_row * width;
+            if( gl->pixelbuffers[ 0 ] )
+                {
+                // the buffer filled now was last used two frames ago, so the driver can copy it right away, and 
+                // the upload to the texture is queued behind the draw rather than done before returning
+                gl->pixelbuffer_index ^= 1;
+                gl->glBindBuffer( APP_GL_PIXEL_UNPACK_BUFFER, gl->pixelbuffers[ gl->pixelbuffer_index ] );
+                gl->glBufferSubData( APP_GL_PIXEL_UNPACK_BUFFER, 0, width * row_count * sizeof( APP_U32 ), rows );
+                gl->glTexSubImage2D( APP_GL_TEXTURE_2D, 0, 0, first_row, width, row_count, APP_GL_RGBA, 
+                    APP_GL_UNSIGNED_BYTE, 0 );
+                gl->glBindBuffer( APP_GL_PIXEL_UNPACK_BUFFER, 0 );
+                }
+            else
+                {
+                gl->glTexSubImage2D( APP_GL_TEXTURE_2D, 0, 0, first_row, width, row_count, APP_GL_RGBA, 
+                    APP_GL_UNSIGNED_BYTE, rows );
+                }
+            }
+        }
     
     if( gl->interpolation == APP_INTERPOLATION_LINEAR )
         {
@@ -1143,7 +1354,7 @@ static void app_internal_opengl_interpolation( struct app_internal_opengl_t* gl,
     }
 
 
-#endif // #ifndef APP_NULL
+#endif // #if !defined( APP_NULL ) && !( defined( APP_LINUX_X11 ) && defined( APP_X11_SHM ) )
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1152,19 +1363,363 @@ static void app_internal_opengl_interpolation( struct app_internal_opengl_t* gl,
 
 #if defined( APP_NULL )
 
+#ifdef APP_NULL_SOUND
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifndef APP_SOUND_SAMPLE_RATE
+#define APP_SOUND_SAMPLE_RATE 44100
+#endif
+
+// where the sound goes - a file name, a named pipe, "-" for stdout, or NULL to just drop it
+#ifndef APP_NULL_SOUND_FILE
+#define APP_NULL_SOUND_FILE NULL
+#endif
+
+// 1 to consume sound at the rate a real device would, 0 to take it as fast as it can be rendered
+#ifndef APP_NULL_SOUND_REALTIME
+#define APP_NULL_SOUND_REALTIME 1
+#endif
+
+// how long app_yield and app_wait keep the app running. when sound is playing, the run is exactly this much sound. 0 exits right away
+#ifndef APP_NULL_RUN_MS
+#define APP_NULL_RUN_MS 0ull
+#endif
+
+#define APP_NULL_MAX_PERIOD_SIZE 4096
+
+struct app_t 
+    { 
+    APP_U64 start_time;
+    pthread_t sound_thread;
+    int sound_thread_running;
+    int exit_sound_thread;
+    void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data );
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data );
+    void* sound_user_data;
+    float sound_vol;
+    int sound_latency_us;
+    int sound_period_size;
+    int sound_period_count;
+    app_sound_params_t sound_params;
+    app_sound_stats_t sound_stats; // only written by the sound thread
+    int sound_stats_reset;
+    APP_U64 sound_frames_written; // over the whole run, only written by the sound thread
+    int sound_finished; // set by the sound thread once the run's sound has been played
+    float sound_buffer[ APP_NULL_MAX_PERIOD_SIZE * 2 ]; // big enough for a period of floats or 16-bit samples
+    };
+
+static APP_U64 app_internal_null_time_ns( void )
+    {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (APP_U64) ts.tv_sec * 1000000000ull + (APP_U64) ts.tv_nsec;
+    }
+
+static void app_internal_null_sleep_until( APP_U64 time_ns )
+    {
+    struct timespec ts;
+    ts.tv_sec = (time_t)( time_ns / 1000000000ull );
+    ts.tv_nsec = (long)( time_ns % 1000000000ull );
+    clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL );
+    }
+
+int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, void* logctx, void* fatalctx ) 
+    { 
+    (void) memctx, (void) logctx, (void) fatalctx;
+    app_t app; 
+    memset( &app, 0, sizeof( app ) );
+    app.start_time = app_internal_null_time_ns();
+    app.sound_vol = 1.0f;
+    app.sound_stats.min_headroom = -1;
+    int result = app_proc( &app, user_data ); 
+    app_sound( &app, 0, NULL, NULL );
+    return result;
+    }
+
+APP_U64 app_time_count( app_t* app ) { (void) app; return app_internal_null_time_ns(); }
+APP_U64 app_time_freq( app_t* app ) { (void) app; return 1000000000ull; }
+
+static APP_U64 app_internal_null_elapsed_ms( app_t* app )
+    {
+    return ( app_internal_null_time_ns() - app->start_time ) / 1000000ull;
+    }
+
+// APP_NULL_RUN_MS is read through a variable, as comparing against a literal 0 is always true and warned about
+static APP_U64 const app_internal_null_run_ms = APP_NULL_RUN_MS;
+
+// while sound is playing the run ends when the sound thread has played all of it, not by the clock, so the amount 
+// of sound doesn't depend on how often the app gets around to asking
+static int app_internal_null_run_over( app_t* app )
+    {
+    if( app_internal_null_run_ms == 0 ) return 1;
+    if( app->sound_thread_running ) return __atomic_load_n( &app->sound_finished, __ATOMIC_ACQUIRE );
+    return app_internal_null_elapsed_ms( app ) >= app_internal_null_run_ms;
+    }
+
+app_state_t app_yield( app_t* app ) 
+    { 
+    if( app_internal_null_run_over( app ) ) return APP_STATE_EXIT_REQUESTED;
+
+    // stand in for waiting on vsync
+    if( APP_NULL_SOUND_REALTIME ) app_internal_null_sleep_until( app_internal_null_time_ns() + 16666667ull );
+    return APP_STATE_NORMAL; 
+    }
+
+app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound ) 
+    { 
+    (void) wake_on_sound;
+    if( app_internal_null_run_over( app ) ) return APP_STATE_EXIT_REQUESTED;
+
+    // there's no input, so only the timeout, the end of the run or the next sound period can wake us up. the sound 
+    // thread decides when the run ends, so while it's playing we check back every period
+    APP_U64 wait_ms = timeout_ms >= 0 ? (APP_U64) timeout_ms : ~0ull;
+    APP_U64 end_ms = app->sound_thread_running ? 
+        app->sound_params.period_size * 1000ull / app->sound_params.sample_rate :
+        app_internal_null_run_ms - app_internal_null_elapsed_ms( app );
+    if( end_ms < wait_ms ) wait_ms = end_ms;
+    if( APP_NULL_SOUND_REALTIME ) app_internal_null_sleep_until( app_internal_null_time_ns() + wait_ms * 1000000ull );
+    return APP_STATE_NORMAL; 
+    }
+
+static void app_internal_null_stat( int* stat, int value ) 
+    { 
+    __atomic_store_n( stat, value, __ATOMIC_RELAXED ); 
+    }
+
+// renders a period in the device format, applies the volume and passes it on to the output file
+static void app_internal_null_sound_period( app_t* app, FILE* file, int count )
+    {
+    float vol = app->sound_vol;
+    if( app->sound_params.format == APP_SOUND_FORMAT_FLOAT )
+        {
+        float* samples = app->sound_buffer;
+        app->sound_callback_f( samples, count, app->sound_user_data );
+        for( int i = 0; i < count * 2; ++i ) samples[ i ] *= vol;
+        if( file ) fwrite( samples, sizeof( float ) * 2, (size_t) count, file );
+        }
+    else
+        {
+        APP_S16* samples = (APP_S16*) app->sound_buffer;
+        app->sound_callback( samples, count, app->sound_user_data );
+        for( int i = 0; i < count * 2; ++i ) samples[ i ] = (APP_S16)( vol * samples[ i ] );
+        if( file ) fwrite( samples, sizeof( APP_S16 ) * 2, (size_t) count, file );
+        }
+    }
+
+// behaves like a sound device thread: it keeps a simulated device buffer topped up a period at a time, and the 
+// device plays it back against the real clock (or instantly, when not running in real time). it renders exactly
+// APP_NULL_RUN_MS worth of sound over the whole run, then waits for it to be played and ends the run
+static void* app_internal_null_sound_thread_proc( void* user_data )
+    {
+    app_t* app = (app_t*) user_data;
+    char const* filename = APP_NULL_SOUND_FILE;
+    FILE* file = NULL;
+    // the device is restarted when its settings change, which carries on the same run in the same file
+    if( filename ) file = strcmp( filename, "-" ) == 0 ? stdout : fopen( filename, app->sound_frames_written ? "ab" : "wb" );
+
+    APP_U64 rate = (APP_U64) app->sound_params.sample_rate;
+    APP_U64 buffer_size = (APP_U64) app->sound_params.buffer_size;
+    APP_U64 period_size = (APP_U64) app->sound_params.period_size;
+    APP_U64 run_frames = app_internal_null_run_ms * rate / 1000ull;
+    APP_U64 left = run_frames > app->sound_frames_written ? run_frames - app->sound_frames_written : 0;
+    APP_U64 written = 0;
+    APP_U64 played = 0;
+    APP_U64 start_time = 0;
+    int running = 0;
+    while( __atomic_load_n( &app->exit_sound_thread, __ATOMIC_ACQUIRE ) == 0 )
+        {
+        if( __atomic_exchange_n( &app->sound_stats_reset, 0, __ATOMIC_ACQ_REL ) )
+            {
+            app_internal_null_stat( &app->sound_stats.underruns, 0 );
+            app_internal_null_stat( &app->sound_stats.recoveries, 0 );
+            app_internal_null_stat( &app->sound_stats.late_refills, 0 );
+            app_internal_null_stat( &app->sound_stats.min_headroom, -1 );
+            }
+
+        if( running && APP_NULL_SOUND_REALTIME )
+            {
+            played = ( app_internal_null_time_ns() - start_time ) * rate / 1000000000ull;
+            if( left == 0 )
+                {
+                // draining at the end of the run, which isn't an underrun
+                if( played > written ) played = written;
+                }
+            else if( played > written )
+                {
+                // ran dry: count it, and restart the device the way snd_pcm_recover would
+                app_internal_null_stat( &app->sound_stats.underruns, app->sound_stats.underruns + 1 );
+                app_internal_null_stat( &app->sound_stats.recoveries, app->sound_stats.recoveries + 1 );
+                running = 0;
+                played = written;
+                }
+            else
+                {
+                int headroom = (int)( written - played );
+                if( app->sound_stats.min_headroom < 0 || headroom < app->sound_stats.min_headroom )
+                    app_internal_null_stat( &app->sound_stats.min_headroom, headroom );
+                if( headroom < (int) period_size )
+                    app_internal_null_stat( &app->sound_stats.late_refills, app->sound_stats.late_refills + 1 );
+                }
+            }
+        else if( running )
+            {
+            played = written; // an infinitely fast device has always played everything
+            }
+        if( running && left == 0 && played == written ) break;
+
+        while( left > 0 && buffer_size - ( written - played ) >= period_size )
+            {
+            APP_U64 count = left < period_size ? left : period_size;
+            app_internal_null_sound_period( app, file, (int) count );
+            written += count;
+            left -= count;
+            app->sound_frames_written += count;
+            }
+
+        if( !running )
+            {
+            // like a device with its start threshold at the buffer size, start once the buffer is full
+            running = 1;
+            start_time = app_internal_null_time_ns() - played * 1000000000ull / rate;
+            }
+
+        // sleep until there's room for another period, or until it has all been played at the end of the run
+        APP_U64 wake_frame = left == 0 ? written : written - buffer_size + period_size;
+        if( APP_NULL_SOUND_REALTIME )
+            app_internal_null_sleep_until( start_time + wake_frame * 1000000000ull / rate );
+        }
+
+    if( file && file != stdout ) fclose( file );
+    if( file == stdout ) fflush( file );
+    if( left == 0 ) __atomic_store_n( &app->sound_finished, 1, __ATOMIC_RELEASE );
+    return NULL;
+    }
+
+static void app_internal_null_sound_stop( app_t* app )
+    {
+    if( !app->sound_thread_running ) return;
+    __atomic_store_n( &app->exit_sound_thread, 1, __ATOMIC_RELEASE );
+    pthread_join( app->sound_thread, NULL );
+    app->sound_thread_running = 0;
+    }
+
+// picks the buffer and period sizes the way a real device might, from what was asked for
+static void app_internal_null_sound_configure( app_t* app, int sample_pairs_count, int is_float )
+    {
+    int rate = APP_SOUND_SAMPLE_RATE;
+    int buffer_size = app->sound_latency_us > 0 ? (int)( (long long) app->sound_latency_us * rate / 1000000 ) : sample_pairs_count;
+    int period_count = app->sound_period_count > 0 ? app->sound_period_count : 4;
+    int period_size = app->sound_period_size > 0 ? app->sound_period_size : buffer_size / period_count;
+    if( period_size > APP_NULL_MAX_PERIOD_SIZE ) period_size = APP_NULL_MAX_PERIOD_SIZE;
+    if( period_size < 16 ) period_size = 16;
+    period_count = buffer_size / period_size;
+    if( period_count < 2 ) period_count = 2;
+    buffer_size = period_size * period_count;
+
+    app->sound_params.format = is_float ? APP_SOUND_FORMAT_FLOAT : APP_SOUND_FORMAT_S16;
+    app->sound_params.sample_rate = rate;
+    app->sound_params.buffer_size = buffer_size;
+    app->sound_params.period_size = period_size;
+    app->sound_params.period_count = period_count;
+    app->sound_params.latency_us = (int)( 1000000ll * buffer_size / rate );
+    }
+
+static void app_internal_null_sound_start( app_t* app, int sample_pairs_count, 
+    void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), 
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+    {
+    app_internal_null_sound_stop( app );
+    app->sound_callback = NULL;
+    app->sound_callback_f = NULL;
+    app->sound_user_data = NULL;
+    if( ( !sound_callback && !sound_callback_f ) || sample_pairs_count <= 0 ) return;
+
+    app->sound_callback = sound_callback;
+    app->sound_callback_f = sound_callback_f;
+    app->sound_user_data = user_data;
+    app_internal_null_sound_configure( app, sample_pairs_count, sound_callback_f != NULL );
+
+    app->exit_sound_thread = 0;
+    app->sound_finished = 0;
+    if( pthread_create( &app->sound_thread, NULL, app_internal_null_sound_thread_proc, app ) == 0 )
+        app->sound_thread_running = 1;
+    }
+
+void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data ) 
+    { 
+    app_internal_null_sound_start( app, sample_pairs_count, sound_callback, NULL, user_data );
+    }
+
+void app_sound_f( app_t* app, int sample_pairs_count, void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data ) 
+    { 
+    app_internal_null_sound_start( app, sample_pairs_count, NULL, sound_callback, user_data );
+    }
+
+void app_sound_volume( app_t* app, float volume ) 
+    { 
+    app->sound_vol = volume < 0.0f ? 0.0f : volume > 1.0f ? 1.0f : volume; 
+    }
+
+void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count ) 
+    { 
+    app->sound_latency_us = latency_us;
+    app->sound_period_size = period_size;
+    app->sound_period_count = period_count;
+    if( app->sound_thread_running )
+        app_internal_null_sound_start( app, app->sound_params.buffer_size, app->sound_callback, app->sound_callback_f, 
+            app->sound_user_data );
+    }
+
+app_sound_params_t app_sound_params( app_t* app ) 
+    { 
+    return app->sound_params; 
+    }
+
+app_sound_stats_t app_sound_stats( app_t* app ) 
+    { 
+    app_sound_stats_t stats;
+    stats.underruns = __atomic_load_n( &app->sound_stats.underruns, __ATOMIC_RELAXED );
+    stats.recoveries = __atomic_load_n( &app->sound_stats.recoveries, __ATOMIC_RELAXED );
+    stats.late_refills = __atomic_load_n( &app->sound_stats.late_refills, __ATOMIC_RELAXED );
+    stats.min_headroom = __atomic_load_n( &app->sound_stats.min_headroom, __ATOMIC_RELAXED );
+    return stats; 
+    }
+
+void app_sound_stats_reset( app_t* app ) 
+    { 
+    __atomic_store_n( &app->sound_stats_reset, 1, __ATOMIC_RELEASE );
+    }
+
+#else
 
 struct app_t { };
 int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, void* logctx, void* fatalctx ) 
     { app_t app; return app_proc( &app, user_data ); }
 app_state_t app_yield( app_t* app ) { return APP_STATE_EXIT_REQUESTED; }
+app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound ) { return APP_STATE_EXIT_REQUESTED; }
+APP_U64 app_time_count( app_t* app ) { return 0; }
+APP_U64 app_time_freq( app_t* app ) { return 0; }
+void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data ) { }
+void app_sound_f( app_t* app, int sample_pairs_count, void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data ) { }
+void app_sound_volume( app_t* app, float volume ) { }
+void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count ) { }
+app_sound_params_t app_sound_params( app_t* app ) { app_sound_params_t params = { 0 }; return params; }
+app_sound_stats_t app_sound_stats( app_t* app ) { app_sound_stats_t stats = { 0 }; stats.min_headroom = -1; return stats; }
+void app_sound_stats_reset( app_t* app ) { }
+
+#endif // APP_NULL_SOUND
+
+
 void app_cancel_exit( app_t* app ) { }
 void app_title( app_t* app, char const* title ) { }
 char const* app_cmdline( app_t* app ) { return 0; }
 char const* app_filename( app_t* app ) { return 0; }
 char const* app_userdata( app_t* app ) { return 0; }
 char const* app_appdata( app_t* app ) { return 0; }
-APP_U64 app_time_count( app_t* app ) { return 0; }
-APP_U64 app_time_freq( app_t* app ) { return 0; }
 void app_log( app_t* app, app_log_level_t level, char const* message ) { }
 void app_fatal_error( app_t* app, char const* message ) { }
 void app_pointer( app_t* app, int width, int height, APP_U32* pixels_abgr, int hotspot_x, int hotspot_y ) { }
@@ -1182,8 +1737,7 @@ int app_window_x( app_t* app ) { return 0; }
 int app_window_y( app_t* app ) { return 0; }
 app_displays_t app_displays( app_t* app ) { app_displays_t x = { 0 }; return x; }
 void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr ) { }
-void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data ) { }
-void app_sound_volume( app_t* app, float volume ) { }
+void app_present_rows( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr, int first_row, int row_count ) { }
 app_input_t app_input( app_t* app ) { app_input_t x = { 0 }; return x; }
 void app_coordinates_window_to_bitmap( app_t* app, int width, int height, int* x, int* y ) { }
 void app_coordinates_bitmap_to_window( app_t* app, int width, int height, int* x, int* y ) { }
@@ -1313,6 +1867,8 @@ struct app_t
     BOOL (APP_GLCALLTYPE* wglSwapIntervalEXT) (int);
 
     HANDLE sound_notifications[ 2 ];
+    HANDLE wake_event;
+    volatile LONG wake_on_sound;
     HMODULE dsound_dll;
     IDirectSound8* dsound;
     IDirectSoundBuffer8* dsoundbuf; 
@@ -1322,6 +1878,9 @@ struct app_t
     int sound_level;
     void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data );
     void* sound_user_data;
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data );
+    void* sound_user_data_f;
+    float sound_buffer_f[ 1024 * 2 ];
 
     HCURSOR current_pointer;
 
@@ -1974,6 +2533,8 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     app->gl.glUniform3f = ( void (APP_GLCALLTYPE*) (APP_GLint, APP_GLfloat, APP_GLfloat, APP_GLfloat) ) (uintptr_t) GetProcAddress( app->gl_dll, "glUniform3f" );
     app->gl.glGetUniformLocation = ( APP_GLint (APP_GLCALLTYPE*) (APP_GLuint, APP_GLchar const*) ) (uintptr_t) GetProcAddress( app->gl_dll, "glGetUniformLocation" );
     app->gl.glTexImage2D = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLint, APP_GLsizei, APP_GLsizei, APP_GLint, APP_GLenum, APP_GLenum, void const*) ) (uintptr_t) GetProcAddress( app->gl_dll, "glTexImage2D" );
+    app->gl.glTexSubImage2D = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLint, APP_GLint, APP_GLsizei, APP_GLsizei, APP_GLenum, APP_GLenum, void const*) ) (uintptr_t) GetProcAddress( app->gl_dll, "glTexSubImage2D" );
+    app->gl.glBufferSubData = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLintptr, APP_GLsizeiptr, void const*) ) (uintptr_t) GetProcAddress( app->gl_dll, "glBufferSubData" );
     app->gl.glClearColor = ( void (APP_GLCALLTYPE*) (APP_GLfloat, APP_GLfloat, APP_GLfloat, APP_GLfloat) ) (uintptr_t) GetProcAddress( app->gl_dll, "glClearColor" );
     app->gl.glClear = ( void (APP_GLCALLTYPE*) (APP_GLbitfield) ) (uintptr_t) GetProcAddress( app->gl_dll, "glClear" );
     app->gl.glDrawArrays = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLsizei) ) (uintptr_t) GetProcAddress( app->gl_dll, "glDrawArrays" );
@@ -2013,6 +2574,8 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     if( !app->gl.glUniform3f ) app->gl.glUniform3f = ( void (APP_GLCALLTYPE*) (APP_GLint, APP_GLfloat, APP_GLfloat, APP_GLfloat) ) (uintptr_t) app->wglGetProcAddress( "glUniform3f" );
     if( !app->gl.glGetUniformLocation ) app->gl.glGetUniformLocation = ( APP_GLint (APP_GLCALLTYPE*) (APP_GLuint, APP_GLchar const*) ) (uintptr_t) app->wglGetProcAddress( "glGetUniformLocation" );
     if( !app->gl.glTexImage2D ) app->gl.glTexImage2D = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLint, APP_GLsizei, APP_GLsizei, APP_GLint, APP_GLenum, APP_GLenum, void const*) ) (uintptr_t) app->wglGetProcAddress( "glTexImage2D" );
+    if( !app->gl.glTexSubImage2D ) app->gl.glTexSubImage2D = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLint, APP_GLint, APP_GLsizei, APP_GLsizei, APP_GLenum, APP_GLenum, void const*) ) (uintptr_t) app->wglGetProcAddress( "glTexSubImage2D" );
+    if( !app->gl.glBufferSubData ) app->gl.glBufferSubData = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLintptr, APP_GLsizeiptr, void const*) ) (uintptr_t) app->wglGetProcAddress( "glBufferSubData" );
     if( !app->gl.glClearColor ) app->gl.glClearColor = ( void (APP_GLCALLTYPE*) (APP_GLfloat, APP_GLfloat, APP_GLfloat, APP_GLfloat) ) (uintptr_t) app->wglGetProcAddress( "glClearColor" );
     if( !app->gl.glClear ) app->gl.glClear = ( void (APP_GLCALLTYPE*) (APP_GLbitfield) ) (uintptr_t) app->wglGetProcAddress( "glClear" );
     if( !app->gl.glDrawArrays ) app->gl.glDrawArrays = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLsizei) ) (uintptr_t) app->wglGetProcAddress( "glDrawArrays" );
@@ -2073,7 +2636,7 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
 
     app->sound_notifications[ 0 ] = CreateEventA( NULL, FALSE, FALSE, NULL );
     app->sound_notifications[ 1 ] = CreateEventA( NULL, FALSE, FALSE, NULL );
-
+    app->wake_event = CreateEventA( NULL, FALSE, FALSE, NULL );
 
     app->dsound_dll = LoadLibraryA( "dsound.dll" );
     if( !app->dsound_dll ) app_log( app, APP_LOG_LEVEL_WARNING, "Couldn't load dsound.dll. Sound disabled." );
@@ -2142,6 +2705,7 @@ init_failed:
     if( app->dsound_dll ) FreeLibrary( app->dsound_dll );
     if( app->sound_notifications[ 0 ] ) CloseHandle( app->sound_notifications[ 0 ] );
     if( app->sound_notifications[ 1 ] ) CloseHandle( app->sound_notifications[ 1 ] );
+    if( app->wake_event ) CloseHandle( app->wake_event );
     if( !app_internal_opengl_term( &app->gl ) ) app_log( app, APP_LOG_LEVEL_WARNING, "Failed to terminate OpenGL" ); 
     if( app->gl_context ) app->wglMakeCurrent( 0, 0 );
     if( app->gl_context ) app->wglDeleteContext( app->gl_context );     
@@ -2206,6 +2770,21 @@ app_state_t app_yield( app_t* app )
     }
 
 
+app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound )
+    {
+    // nothing to wait for before the window is shown, or while there are messages already queued
+    MSG msg;
+    if( app->initialized && !PeekMessage( &msg, NULL, 0, 0, PM_NOREMOVE ) )
+        {
+        InterlockedExchange( &app->wake_on_sound, wake_on_sound ? 1 : 0 );
+        MsgWaitForMultipleObjects( 1, &app->wake_event, FALSE, timeout_ms < 0 ? INFINITE : (DWORD) timeout_ms, 
+            QS_ALLINPUT );
+        InterlockedExchange( &app->wake_on_sound, 0 );
+        }
+    return app_yield( app );
+    }
+
+
 void app_cancel_exit( app_t* app )
     {
     app->closed = FALSE;
@@ -2737,14 +3316,22 @@ app_displays_t app_displays( app_t* app )
     }
 
 
-void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr )
+void app_present_rows( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, 
+    APP_U32 border_xbgr, int first_row, int row_count )
     {
     if( app->is_minimized ) return;
-    if( pixels_xbgr ) app_internal_opengl_present( &app->gl, pixels_xbgr, width, height, mod_xbgr, border_xbgr );  
+    if( pixels_xbgr ) app_internal_opengl_present( &app->gl, pixels_xbgr, width, height, mod_xbgr, border_xbgr, 
+        first_row, row_count );  
     SwapBuffers( app->hdc );
     }
 
 
+void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr )
+    {
+    app_present_rows( app, pixels_xbgr, width, height, mod_xbgr, border_xbgr, 0, height );
+    }
+
+
 static void app_sound_write( app_t* app, int sample_pairs_offset, int sample_pairs_count ) 
     { 
     int offset = sample_pairs_offset * 2 * ( 16 / 8 );
@@ -2802,10 +3389,14 @@ static DWORD WINAPI app_sound_thread_proc( LPVOID lpThreadParameter )
         IDirectSoundBuffer8_GetCurrentPosition( app->dsoundbuf, &position, 0 );
         int pos = ( (int) position )/( 2 * ( 16 / 8 ) );
 
+        int written = 0;
         if( prev_pos >= mid_point && pos < mid_point )
-            app_sound_write( app, mid_point, half_size );
+            { app_sound_write( app, mid_point, half_size ); written = 1; }
         else if( prev_pos < mid_point && pos >= mid_point )
-            app_sound_write( app, 0, half_size );
+            { app_sound_write( app, 0, half_size ); written = 1; }
+
+        // let a main thread sleeping in app_wait know there's a new position to show
+        if( written && InterlockedCompareExchange( &app->wake_on_sound, 0, 0 ) ) SetEvent( app->wake_event );
 
         prev_pos = pos; 
         }
@@ -2939,6 +3530,35 @@ void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_
     }
 
 
+static void app_internal_sound_f_to_s16( APP_S16* sample_pairs, int sample_pairs_count, void* user_data )
+    {
+    app_t* app = (app_t*) user_data;
+    while( sample_pairs_count > 0 )
+        {
+        int count = sample_pairs_count < 1024 ? sample_pairs_count : 1024;
+        app->sound_callback_f( app->sound_buffer_f, count, app->sound_user_data_f );
+        for( int i = 0; i < count * 2; ++i )
+            {
+            float sample = app->sound_buffer_f[ i ];
+            sample = sample < -1.0f ? -1.0f : sample > 1.0f ? 1.0f : sample;
+            sample_pairs[ i ] = (APP_S16)( sample * 32767.0f );
+            }
+        sample_pairs += count * 2;
+        sample_pairs_count -= count;
+        }
+    }
+
+
+void app_sound_f( app_t* app, int sample_pairs_count, void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+    {
+    // directsound is always set up for 16-bit, so render floats a block at a time and convert
+    app->sound_callback_f = sound_callback;
+    app->sound_user_data_f = user_data;
+    if( !sound_callback ) app_sound( app, 0, NULL, NULL );
+    else app_sound( app, sample_pairs_count, app_internal_sound_f_to_s16, app );
+    }
+
+
 void app_sound_volume( app_t* app, float volume )
     {
     if( !app->dsound ) return;
@@ -2952,6 +3572,41 @@ void app_sound_volume( app_t* app, float volume )
     }
 
 
+void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count )
+    {
+    (void) app, (void) latency_us, (void) period_size, (void) period_count;
+    }
+
+
+app_sound_params_t app_sound_params( app_t* app )
+    {
+    // the stream buffer is played in two halves, see app_sound_thread_proc
+    app_sound_params_t params;
+    params.format = APP_SOUND_FORMAT_S16;
+    params.sample_rate = 44100;
+    params.buffer_size = app->sample_pairs_count;
+    params.period_size = app->sample_pairs_count / 2;
+    params.period_count = 2;
+    params.latency_us = (int)( ( 1000000LL * app->sample_pairs_count ) / 44100 );
+    return params;
+    }
+
+
+app_sound_stats_t app_sound_stats( app_t* app )
+    {
+    (void) app;
+    app_sound_stats_t stats = { 0 };
+    stats.min_headroom = -1; // not measured
+    return stats;
+    }
+
+
+void app_sound_stats_reset( app_t* app )
+    {
+    (void) app;
+    }
+
+
 app_input_t app_input( app_t* app )
     {
     app_input_t input; 
@@ -3346,6 +4001,13 @@ struct app_t
     int audio_buffer_size;
     int audio_buffer_position;
     float sound_vol;
+
+    // set by app_sound/app_sound_f, and called from the render callback instead of playing audio_buffer
+    void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data );
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data );
+    void* sound_user_data;
+    int sample_pairs_count;
+    float sound_buffer_f[ 1024 * 2 ];
 };
 
 static app_key_t app_internal_osx_map_key(int keyCode, char keyChar)
@@ -3879,19 +4541,46 @@ OSStatus app_internal_osx_audio_output_cb(
                     AudioBufferList             *ioData)
 {
     app_t* app = (app_t*) inRefCon;
-    if(app->audio_buffer == NULL)
-        return noErr;
-    
-    short* inbuf = (short*)app->audio_buffer;
     short* outbuf = (short*)ioData->mBuffers[0].mData;
-    
-    int read_pos = app->audio_buffer_position;
-    int buf_end = app->audio_buffer_size;
     float vol = app->sound_vol;
-    for (UInt32 frame = 0; frame < inNumberFrames; frame++)
-    {
-        outbuf[frame*2] = (short)(vol * inbuf[read_pos*2]);
-        outbuf[frame*2+1] = (short)(vol * inbuf[read_pos*2+1]);
+
+    // the unit is always set up for 16-bit, so float callbacks render a block at a time and are converted
+    if(app->sound_callback_f != NULL)
+    {
+        UInt32 done = 0;
+        while(done < inNumberFrames)
+        {
+            int count = inNumberFrames - done < 1024 ? (int)(inNumberFrames - done) : 1024;
+            app->sound_callback_f(app->sound_buffer_f, count, app->sound_user_data);
+            for(int i = 0; i < count * 2; ++i)
+            {
+                float sample = vol * app->sound_buffer_f[i];
+                sample = sample < -1.0f ? -1.0f : sample > 1.0f ? 1.0f : sample;
+                outbuf[done*2 + i] = (short)(sample * 32767.0f);
+            }
+            done += count;
+        }
+        return noErr;
+    }
+    if(app->sound_callback != NULL)
+    {
+        app->sound_callback(outbuf, (int)inNumberFrames, app->sound_user_data);
+        for(UInt32 i = 0; i < inNumberFrames * 2; ++i)
+            outbuf[i] = (short)(vol * outbuf[i]);
+        return noErr;
+    }
+
+    if(app->audio_buffer == NULL)
+        return noErr;
+    
+    short* inbuf = (short*)app->audio_buffer;
+    
+    int read_pos = app->audio_buffer_position;
+    int buf_end = app->audio_buffer_size;
+    for (UInt32 frame = 0; frame < inNumberFrames; frame++)
+    {
+        outbuf[frame*2] = (short)(vol * inbuf[read_pos*2]);
+        outbuf[frame*2+1] = (short)(vol * inbuf[read_pos*2+1]);
 
         read_pos++;
         if(read_pos == buf_end)
@@ -3958,6 +4647,10 @@ void app_internal_osx_audio_init(app_t* app)
     app->audio_buffer_size = 0;
     app->audio_buffer_position = 0;
     app->sound_vol = 1.0f;
+    app->sound_callback = NULL;
+    app->sound_callback_f = NULL;
+    app->sound_user_data = NULL;
+    app->sample_pairs_count = 0;
 }
 
 int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, void* logctx, void* fatalctx )
@@ -4066,6 +4759,8 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     app->gl.glUniform3f = glUniform3f;
     app->gl.glGetUniformLocation = glGetUniformLocation;
     app->gl.glTexImage2D = glTexImage2D;
+    app->gl.glTexSubImage2D = glTexSubImage2D;
+    app->gl.glBufferSubData = glBufferSubData;
     app->gl.glClearColor = glClearColor;
     app->gl.glClear = glClear;
     app->gl.glDrawArrays = glDrawArrays;
@@ -4141,6 +4836,13 @@ app_state_t app_yield( app_t* app )
     return app->closed ? APP_STATE_EXIT_REQUESTED : APP_STATE_NORMAL;
 }
 
+// the run loop and the sound thread aren't hooked up to anything we could sleep on, so just yield
+app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound )
+{
+    (void) timeout_ms, (void) wake_on_sound;
+    return app_yield( app );
+}
+
 void app_cancel_exit( app_t* app )
 {
     app->closed = false;
@@ -4313,14 +5015,27 @@ app_displays_t app_displays( app_t* app )
     return displays;
 }
 
-void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr )
+void app_present_rows( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, 
+    APP_U32 border_xbgr, int first_row, int row_count )
 {
-    if( pixels_xbgr ) app_internal_opengl_present( &app->gl, pixels_xbgr, width, height, mod_xbgr, border_xbgr );
+    if( pixels_xbgr ) app_internal_opengl_present( &app->gl, pixels_xbgr, width, height, mod_xbgr, border_xbgr, 
+        first_row, row_count );
     app_internal_osx_present(app->window);
 }
 
+void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr )
+{
+    app_present_rows( app, pixels_xbgr, width, height, mod_xbgr, border_xbgr, 0, height );
+}
+
 void app_sound_buffer_size( app_t* app, int sample_pairs_count )
 {
+    AudioOutputUnitStop(app->audioUnit);
+    app->sound_callback = NULL;
+    app->sound_callback_f = NULL;
+    app->sound_user_data = NULL;
+    app->sample_pairs_count = sample_pairs_count > 0 ? sample_pairs_count : 0;
+
     if(app->audio_buffer != NULL)
     {
         APP_FREE(app->memctx, app->audio_buffer);
@@ -4360,6 +5075,45 @@ void app_sound_write( app_t* app, int sample_pairs_offset, int sample_pairs_coun
     }
 }
 
+static void app_internal_osx_sound_callback( app_t* app, int sample_pairs_count, 
+    void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), 
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+{
+    // stopping the unit waits for the render callback to finish, so it's safe to swap the callbacks after it
+    AudioOutputUnitStop(app->audioUnit);
+    if(app->audio_buffer != NULL)
+    {
+        APP_FREE(app->memctx, app->audio_buffer);
+        app->audio_buffer = NULL;
+        app->audio_buffer_size = 0;
+    }
+
+    if((!sound_callback && !sound_callback_f) || sample_pairs_count <= 0)
+    {
+        app->sound_callback = NULL;
+        app->sound_callback_f = NULL;
+        app->sound_user_data = NULL;
+        app->sample_pairs_count = 0;
+        return;
+    }
+
+    app->sound_callback = sound_callback;
+    app->sound_callback_f = sound_callback_f;
+    app->sound_user_data = user_data;
+    app->sample_pairs_count = sample_pairs_count;
+    AudioOutputUnitStart(app->audioUnit);
+}
+
+void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+{
+    app_internal_osx_sound_callback(app, sample_pairs_count, sound_callback, NULL, user_data);
+}
+
+void app_sound_f( app_t* app, int sample_pairs_count, void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+{
+    app_internal_osx_sound_callback(app, sample_pairs_count, NULL, sound_callback, user_data);
+}
+
 void app_sound_volume( app_t* app, float volume )
 {
     if(volume > 1.0f) volume = 1.0f;
@@ -4367,6 +5121,39 @@ void app_sound_volume( app_t* app, float volume )
     app->sound_vol = volume;
 }
 
+void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count )
+{
+    // the default output unit picks its own buffer sizes
+    (void) app, (void) latency_us, (void) period_size, (void) period_count;
+}
+
+app_sound_params_t app_sound_params( app_t* app )
+{
+    // the unit asks for as many frames as it needs on each render callback, so all we know is the buffer size we
+    // were given
+    app_sound_params_t params;
+    params.format = APP_SOUND_FORMAT_S16;
+    params.sample_rate = 44100;
+    params.buffer_size = app->sample_pairs_count;
+    params.period_size = app->sample_pairs_count;
+    params.period_count = 1;
+    params.latency_us = (int)( ( 1000000LL * app->sample_pairs_count ) / 44100 );
+    return params;
+}
+
+app_sound_stats_t app_sound_stats( app_t* app )
+{
+    (void) app;
+    app_sound_stats_t stats = { 0 };
+    stats.min_headroom = -1; // not measured
+    return stats;
+}
+
+void app_sound_stats_reset( app_t* app )
+{
+    (void) app;
+}
+
 app_input_t app_input( app_t* app )
 {
     app_input_t input;
@@ -4463,9 +5250,39 @@ void app_coordinates_bitmap_to_window( app_t* app, int width, int height, int* x
 #include <time.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
-#include <GL/gl.h>
-#include <GL/glx.h>
+#ifdef APP_X11_SHM
+    #include <string.h>
+    #include <X11/Xutil.h>
+    #include <X11/extensions/XShm.h>
+    #include <sys/ipc.h>
+    #include <sys/shm.h>
+#else
+    #include <GL/gl.h>
+    #include <GL/glx.h>
+#endif
 #include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// SCHED_FIFO priority for the sound thread, 0 leaves it at normal priority (real-time needs rtprio permissions)
+#ifndef APP_SOUND_THREAD_PRIORITY
+#define APP_SOUND_THREAD_PRIORITY 0
+#endif
+
+// define to always use snd_pcm_writei, rather than rendering straight into the device buffer when it can be mapped
+// #define APP_SOUND_NO_MMAP
+
+// the sample rate asked of the sound device. it may end up at another rate, see app_sound_params
+#ifndef APP_SOUND_SAMPLE_RATE
+#define APP_SOUND_SAMPLE_RATE 44100
+#endif
+
+// number of sample pairs the sound thread renders and writes per call when the device buffer isn't mapped
+#ifndef APP_SOUND_CHUNK_SIZE
+#define APP_SOUND_CHUNK_SIZE 1024
+#endif
 
 #ifndef APP_MALLOC
 #include <stdlib.h>
@@ -4515,13 +5332,27 @@ struct app_t
 
     Display* display;
     Window window;
+#ifdef APP_X11_SHM
+    GC gc;
+    XImage* image; // window sized, bitmaps are scaled into it and put to the window from it
+    XShmSegmentInfo shm_info;
+    bool shm_available; // false once attaching has failed, e.g. on a server on another machine
+    bool image_shm; // whether image lives in shm_info's segment or in memory of our own
+    bool image_stale; // the window has been exposed, or the bitmap size or border changed, so put all of it next time
+    int image_bitmap_width;
+    int image_bitmap_height;
+    APP_U32 image_border_xbgr;
+#else
     GLXContext glContext;
     Colormap colMap;
+#endif
 
     int display_count;
     app_display_t displays[ 16 ];
     
+#ifndef APP_X11_SHM
     struct app_internal_opengl_t gl;
+#endif
     
     app_input_event_t input_events[ 1024 ];
     int input_count;
@@ -4536,16 +5367,38 @@ struct app_t
     snd_pcm_t* alsa_handle;
     snd_pcm_hw_params_t* alsa_hw_params;
 
+    pthread_t sound_thread;
+    bool sound_thread_running;
+    int exit_sound_thread;
+    void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data );
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data );
+    void* sound_user_data;
+    APP_S16 sound_chunk[ APP_SOUND_CHUNK_SIZE * 2 ];
+    float sound_chunk_f[ APP_SOUND_CHUNK_SIZE * 2 ]; // also holds 32-bit samples for snd_pcm_writei
+    int sound_latency_us;
+    int sound_period_size;
+    int sound_period_count;
+    app_sound_params_t sound_params;
+    app_sound_format_t sound_format;
+    bool sound_mmap;
+    app_sound_stats_t sound_stats; // only written by the sound thread
+    int sound_stats_reset;
+    int wake_pipe[ 2 ]; // the sound thread writes a byte to it to wake up app_wait
+    int wake_on_sound;
+
     APP_S16* audio_buffer;
     int audio_buffer_size;
     int audio_buffer_position;
     float sound_vol;
 };
 
+#ifndef APP_X11_SHM
 #define GLX_CONTEXT_MAJOR_VERSION_ARB       0x2091
 #define GLX_CONTEXT_MINOR_VERSION_ARB       0x2092
 typedef GLXContext (*glXCreateContextAttribsARBProc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
-typedef void(*glXSwapIntervalProc)(unsigned int);
+typedef void(*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+typedef int(*glXSwapIntervalMESAProc)(unsigned int);
+#endif
 
 static app_key_t app_internal_x11_map_key(KeySym keyCode, char keyChar)
 {
@@ -4662,6 +5515,271 @@ void app_internal_x11_add_scroll_event(app_t* app, float scrollY)
 }
 
 
+#ifdef APP_X11_SHM
+
+static bool app_internal_x11_shm_error = false;
+static int app_internal_x11_shm_error_handler( Display* dpy, XErrorEvent* ev )
+{
+    (void) dpy, (void) ev;
+    app_internal_x11_shm_error = true;
+    return 0;
+}
+
+extern char *__progname;
+void app_internal_x11_view_init(app_t* app, int width, int height)
+{
+    Display *display = XOpenDisplay(NULL);
+
+    if (!display)
+    {
+        app_fatal_error(app, "Failed to open X display\n");
+    }
+
+    // No GLX, just a plain window on the default visual, which the image is made to match
+    int screen = DefaultScreen( display );
+    XSetWindowAttributes swa;
+    swa.background_pixmap = None; // everything is put there by app_present, so don't let the server clear it first
+    swa.border_pixel      = 0;
+    swa.event_mask        = StructureNotifyMask;
+
+    Window win = XCreateWindow( display, RootWindow( display, screen ), 
+                                0, 0, width, height, 0, DefaultDepth( display, screen ), InputOutput, 
+                                DefaultVisual( display, screen ), 
+                                CWBackPixmap|CWBorderPixel|CWEventMask, &swa );
+    if ( !win )
+    {
+        app_fatal_error( app, "Failed to create window.\n" );
+    }
+
+    XStoreName( display, win, __progname );
+
+    Atom wmDeleteMessage = XInternAtom(display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(display, win, &wmDeleteMessage, 1); 
+
+    XSelectInput(display, win,  ButtonPressMask | ButtonReleaseMask |
+                                KeyPressMask | KeyReleaseMask |
+                                ButtonMotionMask | PointerMotionMask |
+                                StructureNotifyMask | ExposureMask );
+
+    app->display = display;
+    app->window = win;
+    app->gc = XCreateGC( display, win, 0, NULL );
+
+    // The extension can be there even when the server is on another machine, in which case attaching fails later
+    app->shm_available = XShmQueryExtension( display ) == True;
+    if( !app->shm_available ) 
+        app_log( app, APP_LOG_LEVEL_WARNING, "MIT-SHM not available, presenting with XPutImage" );
+}
+
+static void app_internal_x11_image_free( app_t* app )
+{
+    if( !app->image ) return;
+    if( app->image_shm )
+    {
+        XShmDetach( app->display, &app->shm_info );
+        XDestroyImage( app->image );
+        shmdt( app->shm_info.shmaddr );
+    }
+    else
+    {
+        XDestroyImage( app->image ); // frees the pixels too
+    }
+    app->image = NULL;
+}
+
+// Makes the window sized image, in memory shared with the server when it can be
+static bool app_internal_x11_image_create( app_t* app, int width, int height )
+{
+    Display* display = app->display;
+    int screen = DefaultScreen( display );
+    Visual* visual = DefaultVisual( display, screen );
+    int depth = DefaultDepth( display, screen );
+
+    if( app->shm_available )
+    {
+        app->image = XShmCreateImage( display, visual, depth, ZPixmap, NULL, &app->shm_info, width, height );
+        if( app->image )
+        {
+            app->shm_info.shmid = shmget( IPC_PRIVATE, app->image->bytes_per_line * height, IPC_CREAT | 0600 );
+            app->shm_info.shmaddr = (char*) -1;
+            if( app->shm_info.shmid >= 0 ) app->shm_info.shmaddr = (char*) shmat( app->shm_info.shmid, NULL, 0 );
+            app->shm_info.readOnly = False;
+            app_internal_x11_shm_error = true;
+            if( app->shm_info.shmaddr != (char*) -1 )
+            {
+                app->image->data = app->shm_info.shmaddr;
+
+                // Attaching reports failure as an X error, so catch it rather than have Xlib exit
+                app_internal_x11_shm_error = false;
+                int (*oldHandler)(Display*, XErrorEvent*) = XSetErrorHandler( &app_internal_x11_shm_error_handler );
+                XShmAttach( display, &app->shm_info );
+                XSync( display, False );
+                XSetErrorHandler( oldHandler );
+            }
+            // Marked for removal right away, so it goes when both sides have detached, even if we crash
+            if( app->shm_info.shmid >= 0 ) shmctl( app->shm_info.shmid, IPC_RMID, NULL );
+
+            if( !app_internal_x11_shm_error )
+            {
+                app->image_shm = true;
+            }
+            else
+            {
+                if( app->shm_info.shmaddr != (char*) -1 ) shmdt( app->shm_info.shmaddr );
+                app->image->data = NULL;
+                XDestroyImage( app->image );
+                app->image = NULL;
+                app->shm_available = false;
+                app_log( app, APP_LOG_LEVEL_WARNING, "Failed to attach MIT-SHM image, presenting with XPutImage" );
+            }
+        }
+    }
+
+    if( !app->image )
+    {
+        // XDestroyImage frees the pixels with free, so they can't come from APP_MALLOC
+        char* data = (char*) malloc( (size_t) width * height * sizeof( APP_U32 ) );
+        if( data ) app->image = XCreateImage( display, visual, depth, ZPixmap, 0, data, width, height, 32, 0 );
+        if( !app->image )
+        {
+            free( data );
+            app_log( app, APP_LOG_LEVEL_ERROR, "Failed to create image" );
+            return false;
+        }
+        // Xlib swaps the bytes on the way to the server if it needs to, as long as this says what we write
+        APP_U32 one = 1;
+        app->image->byte_order = *(char*) &one ? LSBFirst : MSBFirst;
+        app->image_shm = false;
+    }
+
+    bool rgb = app->image->red_mask == 0xff0000 && app->image->blue_mask == 0xff;
+    bool bgr = app->image->red_mask == 0xff && app->image->blue_mask == 0xff0000;
+    if( app->image->bits_per_pixel != 32 || app->image->green_mask != 0xff00 || ( !rgb && !bgr ) )
+    {
+        app_internal_x11_image_free( app );
+        app_log( app, APP_LOG_LEVEL_ERROR, "Unsupported visual, needs 8 bits per channel in 32 bit pixels" );
+        return false;
+    }
+
+    app->image_stale = true;
+    return true;
+}
+
+static APP_U32 app_internal_x11_swap_rb( APP_U32 color )
+{
+    return ( ( color & 0xff ) << 16 ) | ( color & 0xff00 ) | ( ( color >> 16 ) & 0xff );
+}
+
+// Converts one bitmap row to the image layout and widens it by pixel_scale, modulating it if mod isn't white
+static void app_internal_x11_scale_row( APP_U32* dst, APP_U32 const* src, int count, int pixel_scale, bool swap_rb, 
+    APP_U32 mod )
+{
+    for( int i = 0; i < count; ++i )
+    {
+        APP_U32 c = swap_rb ? app_internal_x11_swap_rb( src[ i ] ) : ( src[ i ] & 0xffffff );
+        if( mod != 0xffffff )
+        {
+            c = ( ( ( ( c >> 16 ) & 0xff ) * ( ( mod >> 16 ) & 0xff ) / 255 ) << 16 ) 
+              | ( ( ( ( c >>  8 ) & 0xff ) * ( ( mod >>  8 ) & 0xff ) / 255 ) <<  8 ) 
+              | ( ( ( ( c       ) & 0xff ) * ( ( mod       ) & 0xff ) / 255 )       );
+        }
+        for( int j = 0; j < pixel_scale; ++j ) *dst++ = c;
+    }
+}
+
+// Scales the rows that changed into the image with the same whole pixel scale and centering as 
+// app_coordinates_window_to_bitmap, and puts just those to the window
+static void app_internal_x11_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, 
+    APP_U32 mod_xbgr, APP_U32 border_xbgr, int first_row, int row_count )
+{
+    int window_width = ( app->screenmode == APP_SCREENMODE_FULLSCREEN ) ? app->fullscreen_width : app->windowed_w;
+    int window_height = ( app->screenmode == APP_SCREENMODE_FULLSCREEN ) ? app->fullscreen_height : app->windowed_h;
+    if( width <= 0 || height <= 0 || window_width <= 0 || window_height <= 0 ) return;
+
+    if( !app->image || app->image->width != window_width || app->image->height != window_height )
+    {
+        app_internal_x11_image_free( app );
+        if( !app_internal_x11_image_create( app, window_width, window_height ) ) return;
+    }
+
+    // Like the OpenGL path, the border and mod colors have red in bits 16-23, the same as an rgb visual
+    bool swap_rb = app->image->red_mask == 0xff0000;
+    APP_U32 border = ( swap_rb ? border_xbgr : app_internal_x11_swap_rb( border_xbgr ) ) & 0xffffff;
+    APP_U32 mod = ( swap_rb ? mod_xbgr : app_internal_x11_swap_rb( mod_xbgr ) ) & 0xffffff;
+
+    int hscale = window_width / width;
+    int vscale = window_height / height;
+    int pixel_scale = hscale < vscale ? hscale : vscale;
+    pixel_scale = pixel_scale < 1 ? 1 : pixel_scale;
+    int hborder = ( window_width - pixel_scale * width ) / 2;
+    int vborder = ( window_height - pixel_scale * height ) / 2;
+
+    int stride = app->image->bytes_per_line;
+    if( app->image_stale || width != app->image_bitmap_width || height != app->image_bitmap_height || 
+        border_xbgr != app->image_border_xbgr )
+    {
+        for( int y = 0; y < window_height; ++y )
+        {
+            APP_U32* row = (APP_U32*)( app->image->data + y * stride );
+            for( int x = 0; x < window_width; ++x ) row[ x ] = border;
+        }
+        app->image_bitmap_width = width;
+        app->image_bitmap_height = height;
+        app->image_border_xbgr = border_xbgr;
+        app->image_stale = true;
+        first_row = 0;
+        row_count = height;
+    }
+
+    // The part of the bitmap that lands inside the window, which is all of it unless the window is smaller
+    int x1 = hborder < 0 ? -hborder : 0;
+    int x2 = ( window_width - hborder ) / pixel_scale;
+    x2 = x2 < width ? x2 : width;
+    int y1 = vborder < 0 ? -vborder : 0;
+    y1 = y1 > first_row ? y1 : first_row;
+    int y2 = ( window_height - vborder ) / pixel_scale;
+    y2 = y2 < first_row + row_count ? y2 : first_row + row_count;
+    y2 = y2 < height ? y2 : height;
+
+    if( x1 < x2 && y1 < y2 )
+    {
+        int span = ( x2 - x1 ) * pixel_scale;
+        for( int y = y1; y < y2; ++y )
+        {
+            char* row = app->image->data + ( vborder + y * pixel_scale ) * stride;
+            APP_U32* dst = (APP_U32*)( row ) + hborder + x1 * pixel_scale;
+            app_internal_x11_scale_row( dst, pixels_xbgr + y * width + x1, x2 - x1, pixel_scale, swap_rb, mod );
+            for( int i = 1; i < pixel_scale; ++i ) 
+                memcpy( (char*) dst + i * stride, dst, span * sizeof( APP_U32 ) );
+        }
+    }
+
+    int put_x = 0, put_y = 0, put_w = window_width, put_h = window_height;
+    if( !app->image_stale )
+    {
+        if( x1 >= x2 || y1 >= y2 ) return;
+        put_x = hborder + x1 * pixel_scale;
+        put_y = vborder + y1 * pixel_scale;
+        put_w = ( x2 - x1 ) * pixel_scale;
+        put_h = ( y2 - y1 ) * pixel_scale;
+    }
+    app->image_stale = false;
+
+    if( app->image_shm )
+    {
+        // The server reads the pixels straight out of the segment, so wait for it before they're written again
+        XShmPutImage( app->display, app->window, app->gc, app->image, put_x, put_y, put_x, put_y, put_w, put_h, False );
+        XSync( app->display, False );
+    }
+    else
+    {
+        XPutImage( app->display, app->window, app->gc, app->image, put_x, put_y, put_x, put_y, put_w, put_h );
+        XFlush( app->display );
+    }
+}
+
+#else
+
 // Helper to check for extension string presence.  Adapted from:
 //   http://www.opengl.org/resources/features/OGLextensions/
 static bool isExtensionSupported(const char *extList, const char *extension)
@@ -4864,20 +5982,20 @@ void app_internal_x11_view_init(app_t* app, int width, int height)
     // Sync to ensure any errors generated are processed.
     XSync( display, False );
 
-    // attempt to enable vsync
-    glXSwapIntervalProc glXSwapInterval = NULL;
+    // attempt to enable vsync. the two extensions take different arguments, the EXT one is per drawable
     if(isExtensionSupported(glxExts, "GLX_EXT_swap_control"))
     {
-        glXSwapInterval = (glXSwapIntervalProc)glXGetProcAddressARB("glXSwapIntervalEXT");
+        glXSwapIntervalEXTProc glXSwapIntervalEXT = 
+            (glXSwapIntervalEXTProc)glXGetProcAddressARB("glXSwapIntervalEXT");
+        if(glXSwapIntervalEXT != NULL)
+            glXSwapIntervalEXT(display, win, 1);
     }
     else if(isExtensionSupported(glxExts, "GLX_MESA_swap_control"))
     {
-        glXSwapInterval = (glXSwapIntervalProc)glXGetProcAddressARB("glXSwapIntervalMESA");
-    }
-
-    if(glXSwapInterval != NULL)
-    {
-        glXSwapInterval(1);
+        glXSwapIntervalMESAProc glXSwapIntervalMESA = 
+            (glXSwapIntervalMESAProc)glXGetProcAddressARB("glXSwapIntervalMESA");
+        if(glXSwapIntervalMESA != NULL)
+            glXSwapIntervalMESA(1);
     }
 
 
@@ -4897,7 +6015,7 @@ void app_internal_x11_view_init(app_t* app, int width, int height)
     XSelectInput(display, win,  ButtonPressMask | ButtonReleaseMask |
                                 KeyPressMask | KeyReleaseMask |
                                 ButtonMotionMask | PointerMotionMask |
-                                StructureNotifyMask );
+                                StructureNotifyMask | ExposureMask );
 
     app->display = display;
     app->window = win;
@@ -4905,6 +6023,18 @@ void app_internal_x11_view_init(app_t* app, int width, int height)
     app->colMap = cmap;
 }
 
+#endif
+
+static void app_internal_x11_view_resize( app_t* app, int width, int height )
+{
+#ifdef APP_X11_SHM
+    // the image is remade at the new size by the next present
+    (void) app, (void) width, (void) height;
+#else
+    app_internal_opengl_resize( &app->gl, width, height );
+#endif
+}
+
 void app_internal_x11_handle_events(app_t* app)
 {
     Atom wmDeleteMessage = XInternAtom(app->display, "WM_DELETE_WINDOW", False);
@@ -4957,10 +6087,18 @@ void app_internal_x11_handle_events(app_t* app)
                         app->windowed_h = ev.height;
                         app->windowed_x = ev.x;
                         app->windowed_y = ev.y;
-                        app_internal_opengl_resize( &app->gl, app->windowed_w, app->windowed_h );
+                        app_internal_x11_view_resize( app, app->windowed_w, app->windowed_h );
                     }
                 }
                 break;
+#ifdef APP_X11_SHM
+            case Expose:
+                {
+                    // only what changes is put to the window, so the next present has to put all of it
+                    app->image_stale = true;
+                }
+                break;
+#endif
             case ClientMessage:
                 {
                     if(event.xclient.data.l[0] == wmDeleteMessage)
@@ -4975,53 +6113,390 @@ void app_internal_x11_handle_events(app_t* app)
     }
 }
 
-static void app_internal_linux_audio_output_cb(snd_async_handler_t *ahandler)
+// the sound thread is the only writer of the stats, other threads just need to see whole values
+static void app_internal_linux_audio_stat(int* stat, int value)
 {
-    snd_pcm_t *alsa_handle = snd_async_handler_get_pcm(ahandler);
-    app_t* app = snd_async_handler_get_callback_private(ahandler);
+    __atomic_store_n(stat, value, __ATOMIC_RELAXED);
+}
 
-    short* buffer = (short*)app->audio_buffer;
-    int read_pos = app->audio_buffer_position;
-    int buf_end = app->audio_buffer_size;
+// returns false if the device couldn't be brought back
+static bool app_internal_linux_audio_recover(app_t* app, int err)
+{
+    if(err == -EPIPE)
+        app_internal_linux_audio_stat(&app->sound_stats.underruns, app->sound_stats.underruns + 1);
 
-    snd_pcm_sframes_t avail;
-    int err;
-    
-    avail = snd_pcm_avail_update(alsa_handle);
+    err = snd_pcm_recover(app->alsa_handle, err, 1);
+    if(err < 0)
+    {
+        app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror(err));
+        return false;
+    }
+    app_internal_linux_audio_stat(&app->sound_stats.recoveries, app->sound_stats.recoveries + 1);
+    return true;
+}
+
+// called each time the sound thread is about to refill a running device
+static void app_internal_linux_audio_update_stats(app_t* app, int avail)
+{
+    if(__atomic_exchange_n(&app->sound_stats_reset, 0, __ATOMIC_ACQ_REL))
+    {
+        app_internal_linux_audio_stat(&app->sound_stats.underruns, 0);
+        app_internal_linux_audio_stat(&app->sound_stats.recoveries, 0);
+        app_internal_linux_audio_stat(&app->sound_stats.late_refills, 0);
+        app_internal_linux_audio_stat(&app->sound_stats.min_headroom, -1);
+    }
+
+    int headroom = app->sound_params.buffer_size - avail;
+    if(app->sound_stats.min_headroom < 0 || headroom < app->sound_stats.min_headroom)
+        app_internal_linux_audio_stat(&app->sound_stats.min_headroom, headroom);
+    if(headroom < app->sound_params.period_size)
+        app_internal_linux_audio_stat(&app->sound_stats.late_refills, app->sound_stats.late_refills + 1);
+}
+
+// fills sample_pairs from whichever 16-bit source is active
+static void app_internal_linux_audio_fill_s16(app_t* app, APP_S16* sample_pairs, int sample_pairs_count)
+{
+    if(app->sound_callback != NULL)
+    {
+        app->sound_callback(sample_pairs, sample_pairs_count, app->sound_user_data);
+    }
+    else if(app->audio_buffer != NULL)
+    {
+        int read_pos = app->audio_buffer_position;
+        int buf_end = app->audio_buffer_size;
+        for(int i=0; i<sample_pairs_count; ++i)
+        {
+            sample_pairs[i*2] = app->audio_buffer[read_pos*2];
+            sample_pairs[i*2+1] = app->audio_buffer[read_pos*2+1];
+
+            read_pos++;
+            if(read_pos == buf_end)
+                read_pos = 0;
+        }
+        app->audio_buffer_position = read_pos;
+    }
+    else
+    {
+        memset(sample_pairs, 0x00, sample_pairs_count * 2 * sizeof(APP_S16));
+    }
+}
+
+static float app_internal_clamp_sample(float sample)
+{
+    return sample < -1.0f ? -1.0f : sample > 1.0f ? 1.0f : sample;
+}
+
+// fills a block of the device buffer, in the device sample format, applying the volume
+static void app_internal_linux_audio_fill(app_t* app, void* buffer, int sample_pairs_count)
+{
+    float vol = app->sound_vol;
+
+    if(app->sound_format == APP_SOUND_FORMAT_S16)
+    {
+        APP_S16* sample_pairs = (APP_S16*)buffer;
+        if(app->sound_callback_f != NULL)
+        {
+            // float renderer on a 16-bit device, convert a chunk at a time
+            for(int done=0; done<sample_pairs_count; )
+            {
+                int count = sample_pairs_count - done < APP_SOUND_CHUNK_SIZE ? sample_pairs_count - done : APP_SOUND_CHUNK_SIZE;
+                app->sound_callback_f(app->sound_chunk_f, count, app->sound_user_data);
+                for(int i=0; i<count * 2; ++i)
+                    sample_pairs[done*2 + i] = (APP_S16)(app_internal_clamp_sample(vol * app->sound_chunk_f[i]) * 32767.0f);
+                done += count;
+            }
+            return;
+        }
+
+        app_internal_linux_audio_fill_s16(app, sample_pairs, sample_pairs_count);
+        if(vol < 1.0f)
+        {
+            for(int i=0; i<sample_pairs_count * 2; ++i)
+                sample_pairs[i] = (APP_S16)(vol * sample_pairs[i]);
+        }
+        return;
+    }
+
+    // float and 32-bit devices both have 4-byte samples: render floats in place, then convert them if needed
+    float* sample_pairs = (float*)buffer;
+    if(app->sound_callback_f != NULL)
+    {
+        app->sound_callback_f(sample_pairs, sample_pairs_count, app->sound_user_data);
+        if(vol < 1.0f)
+        {
+            for(int i=0; i<sample_pairs_count * 2; ++i)
+                sample_pairs[i] *= vol;
+        }
+    }
+    else
+    {
+        for(int done=0; done<sample_pairs_count; )
+        {
+            int count = sample_pairs_count - done < APP_SOUND_CHUNK_SIZE ? sample_pairs_count - done : APP_SOUND_CHUNK_SIZE;
+            app_internal_linux_audio_fill_s16(app, app->sound_chunk, count);
+            for(int i=0; i<count * 2; ++i)
+                sample_pairs[done*2 + i] = vol * app->sound_chunk[i] * (1.0f / 32768.0f);
+            done += count;
+        }
+    }
 
-//    printf("Audio: %llu\n", avail);
+    if(app->sound_format == APP_SOUND_FORMAT_S32)
+    {
+        int* samples = (int*)buffer;
+        for(int i=0; i<sample_pairs_count * 2; ++i)
+            samples[i] = (int)((double)app_internal_clamp_sample(sample_pairs[i]) * 2147483647.0);
+    }
+}
 
-//    while(avail > (app->audio_buffer_size / 4))
+// renders into a chunk buffer and copies it to the device with snd_pcm_writei
+static void app_internal_linux_audio_write_rw(app_t* app, snd_pcm_sframes_t avail)
+{
+    while(avail > 0)
     {
-        snd_pcm_sframes_t num_frames = buf_end - read_pos;
-        if(num_frames > avail)
-            num_frames = avail;
+        void* chunk = app->sound_format == APP_SOUND_FORMAT_S16 ? (void*)app->sound_chunk : (void*)app->sound_chunk_f;
+        int frame_size = app->sound_format == APP_SOUND_FORMAT_S16 ? 2 * sizeof(APP_S16) : 2 * sizeof(float);
+        int num_frames = avail > APP_SOUND_CHUNK_SIZE ? APP_SOUND_CHUNK_SIZE : (int)avail;
+        app_internal_linux_audio_fill(app, chunk, num_frames);
+
+        // the whole chunk has to go in before the next one is rendered, or what's left of it is skipped. a short 
+        // write (a signal, or an xrun partway through) just carries on from where it stopped
+        char* frames = (char*)chunk;
+        int left = num_frames;
+        while(left > 0)
+        {
+            snd_pcm_sframes_t written = snd_pcm_writei(app->alsa_handle, frames, left);
+            if(written < 0)
+            {
+                if(!app_internal_linux_audio_recover(app, (int)written))
+                    return;
+                continue;
+            }
+            frames += written * frame_size;
+            left -= (int)written;
+        }
+        avail -= num_frames;
+    }
+}
 
-        err = snd_pcm_writei(alsa_handle, &buffer[read_pos*2], num_frames);
-        if (err < 0) 
+// renders straight into the mapped device buffer, which may take a couple of goes if the free part wraps around
+static void app_internal_linux_audio_write_mmap(app_t* app, snd_pcm_sframes_t avail)
+{
+    while(avail > 0)
+    {
+        const snd_pcm_channel_area_t* areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = (snd_pcm_uframes_t)avail;
+        int err = snd_pcm_mmap_begin(app->alsa_handle, &areas, &offset, &frames);
+        if(err < 0)
         {
-            printf("Write error: %s\n", snd_strerror(err));
+            app_internal_linux_audio_recover(app, err);
             return;
         }
-        if (err != num_frames) {
-            printf("Write error: written %i expected %li\n", err, num_frames);
+
+        // interleaved, so the first area describes the whole frame. first and step are in bits
+        char* sample_pairs = (char*)areas[0].addr + areas[0].first / 8 + offset * (areas[0].step / 8);
+        app_internal_linux_audio_fill(app, sample_pairs, (int)frames);
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(app->alsa_handle, offset, frames);
+        if(committed < 0 || (snd_pcm_uframes_t)committed != frames)
+        {
+            app_internal_linux_audio_recover(app, committed < 0 ? (int)committed : -EPIPE);
             return;
         }
+        avail -= (snd_pcm_sframes_t)frames;
+    }
 
-        read_pos += num_frames;
-        if(read_pos == buf_end)
-            read_pos = 0;
+    // unlike writei, committing doesn't start the device, so kick it off once the buffer has been filled
+    if(snd_pcm_state(app->alsa_handle) == SND_PCM_STATE_PREPARED)
+    {
+        int err = snd_pcm_start(app->alsa_handle);
+        if(err < 0)
+            app_internal_linux_audio_recover(app, err);
+    }
+}
 
-        avail = snd_pcm_avail_update(alsa_handle);
+static void* app_internal_linux_audio_thread_proc(void* user_data)
+{
+    app_t* app = (app_t*)user_data;
+
+#if APP_SOUND_THREAD_PRIORITY > 0
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = APP_SOUND_THREAD_PRIORITY;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+        app_log(app, APP_LOG_LEVEL_WARNING, "Couldn't set real-time priority for sound thread");
+#endif
+
+    while(__atomic_load_n(&app->exit_sound_thread, __ATOMIC_ACQUIRE) == 0)
+    {
+        // wake up when the device wants more data, with a timeout so we notice exit requests
+        int err = snd_pcm_wait(app->alsa_handle, 100);
+        if(err < 0)
+        {
+            app_internal_linux_audio_recover(app, err);
+            continue;
+        }
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(app->alsa_handle);
+        if(avail < 0)
+        {
+            app_internal_linux_audio_recover(app, (int)avail);
+            continue;
+        }
+
+        // while priming the buffer, before the device starts, there's nothing to measure
+        if(snd_pcm_state(app->alsa_handle) == SND_PCM_STATE_RUNNING)
+            app_internal_linux_audio_update_stats(app, (int)avail);
+
+        if(app->sound_mmap)
+            app_internal_linux_audio_write_mmap(app, avail);
+        else
+            app_internal_linux_audio_write_rw(app, avail);
+
+        // let a main thread sleeping in app_wait know there's a new position to show. if the pipe is full it's 
+        // already awake
+        if(__atomic_load_n(&app->wake_on_sound, __ATOMIC_ACQUIRE) && app->wake_pipe[1] >= 0)
+        {
+            char byte = 0;
+            ssize_t written = write(app->wake_pipe[1], &byte, 1);
+            (void) written;
+        }
     }
 
-    app->audio_buffer_position = read_pos;
+    return NULL;
 }
 
-int app_internal_linux_audio_init(app_t* app)
+static void app_internal_linux_audio_start_thread(app_t* app)
+{
+    if(app->alsa_handle == NULL || app->sound_thread_running)
+        return;
+
+    int err = snd_pcm_prepare(app->alsa_handle);
+    if(err < 0)
+    {
+        app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror(err));
+        return;
+    }
+
+    app->exit_sound_thread = 0;
+    if(pthread_create(&app->sound_thread, NULL, app_internal_linux_audio_thread_proc, app) != 0)
+    {
+        app_log(app, APP_LOG_LEVEL_WARNING, "Couldn't create sound thread");
+        return;
+    }
+    app->sound_thread_running = true;
+}
+
+// stops the sound thread (if running) and leaves the device stopped, ready to be reconfigured
+static void app_internal_linux_audio_stop_thread(app_t* app)
 {
-    (void)app;
+    if(app->sound_thread_running)
+    {
+        __atomic_store_n(&app->exit_sound_thread, 1, __ATOMIC_RELEASE);
+        pthread_join(app->sound_thread, NULL);
+        app->sound_thread_running = false;
+    }
+
+    snd_pcm_drop(app->alsa_handle);
+}
+
+// (re)negotiates the hardware parameters, the device must not be running. the latency and period requested with 
+// app_sound_latency take precedence over buffer_size_in_frames, anything left at 0 is up to ALSA.
+static int app_internal_linux_audio_configure(app_t* app, int buffer_size_in_frames)
+{
+    int err = 0;
+    snd_pcm_t* alsa_handle = app->alsa_handle;
+    snd_pcm_hw_params_t* hw_params = app->alsa_hw_params;
+
+    unsigned int sample_rate = APP_SOUND_SAMPLE_RATE;
+    snd_pcm_hw_params_any (alsa_handle, hw_params);
+    app->sound_mmap = false;
+#ifndef APP_SOUND_NO_MMAP
+    app->sound_mmap = snd_pcm_hw_params_test_access (alsa_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+#endif
+    snd_pcm_hw_params_set_access (alsa_handle, hw_params, 
+        app->sound_mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
+
+    // a float renderer gets a float (or failing that 32-bit) device if there is one, so nothing is lost to 16 bits
+    app->sound_format = APP_SOUND_FORMAT_S16;
+    if(app->sound_callback_f != NULL)
+    {
+        if(snd_pcm_hw_params_test_format (alsa_handle, hw_params, SND_PCM_FORMAT_FLOAT_LE) == 0)
+            app->sound_format = APP_SOUND_FORMAT_FLOAT;
+        else if(snd_pcm_hw_params_test_format (alsa_handle, hw_params, SND_PCM_FORMAT_S32_LE) == 0)
+            app->sound_format = APP_SOUND_FORMAT_S32;
+    }
+    snd_pcm_hw_params_set_format (alsa_handle, hw_params, 
+        app->sound_format == APP_SOUND_FORMAT_FLOAT ? SND_PCM_FORMAT_FLOAT_LE : 
+        app->sound_format == APP_SOUND_FORMAT_S32 ? SND_PCM_FORMAT_S32_LE : SND_PCM_FORMAT_S16_LE);
+    // take the closest rate the hardware runs at natively, rather than have ALSA resample to the one we asked for.
+    // programs should render at the rate reported by app_sound_params, so the sound is only resampled once.
+    snd_pcm_hw_params_set_rate_resample (alsa_handle, hw_params, 0);
+    snd_pcm_hw_params_set_rate_near (alsa_handle, hw_params, &sample_rate, 0);
+    snd_pcm_hw_params_set_channels (alsa_handle, hw_params, 2);
+
+    // the buffer first, then fit the periods into it
+    if(app->sound_latency_us > 0)
+    {
+        unsigned int buffer_time = (unsigned int)app->sound_latency_us;
+        if ((err = snd_pcm_hw_params_set_buffer_time_near (alsa_handle, hw_params, &buffer_time, 0)) < 0) 
+            app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror (err));
+    }
+    else if(buffer_size_in_frames > 0)
+    {
+        snd_pcm_uframes_t buffer_size = (snd_pcm_uframes_t)buffer_size_in_frames;
+        if ((err = snd_pcm_hw_params_set_buffer_size_near (alsa_handle, hw_params, &buffer_size)) < 0) 
+            app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror (err));
+    }
+    if(app->sound_period_count > 0)
+    {
+        unsigned int periods = (unsigned int)app->sound_period_count;
+        if ((err = snd_pcm_hw_params_set_periods_near (alsa_handle, hw_params, &periods, 0)) < 0) 
+            app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror (err));
+    }
+    if(app->sound_period_size > 0)
+    {
+        snd_pcm_uframes_t period_size = (snd_pcm_uframes_t)app->sound_period_size;
+        if ((err = snd_pcm_hw_params_set_period_size_near (alsa_handle, hw_params, &period_size, 0)) < 0) 
+            app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror (err));
+    }
+
+    if ((err = snd_pcm_hw_params (alsa_handle, hw_params)) < 0) 
+    {
+        app_log(app, APP_LOG_LEVEL_ERROR, snd_strerror (err));
+        return err;
+    }
 
+    snd_pcm_uframes_t buffer_size = 0;
+    snd_pcm_uframes_t period_size = 0;
+    unsigned int periods = 0;
+    snd_pcm_hw_params_get_rate (hw_params, &sample_rate, 0);
+    snd_pcm_hw_params_get_buffer_size (hw_params, &buffer_size);
+    snd_pcm_hw_params_get_period_size (hw_params, &period_size, 0);
+    snd_pcm_hw_params_get_periods (hw_params, &periods, 0);
+
+    app->sound_params.format = app->sound_format;
+    app->sound_params.sample_rate = (int)sample_rate;
+    app->sound_params.buffer_size = (int)buffer_size;
+    app->sound_params.period_size = (int)period_size;
+    app->sound_params.period_count = (int)periods;
+    app->sound_params.latency_us = sample_rate ? (int)( ( 1000000ULL * buffer_size ) / sample_rate ) : 0;
+
+    // wake the sound thread once per period, and don't start playing until the whole buffer has been filled
+    snd_pcm_sw_params_t* sw_params;
+    snd_pcm_sw_params_malloc (&sw_params);
+    snd_pcm_sw_params_current (alsa_handle, sw_params);
+    snd_pcm_sw_params_set_avail_min (alsa_handle, sw_params, period_size);
+    snd_pcm_sw_params_set_start_threshold (alsa_handle, sw_params, buffer_size);
+    if ((err = snd_pcm_sw_params (alsa_handle, sw_params)) < 0) 
+        app_log(app, APP_LOG_LEVEL_WARNING, snd_strerror (err));
+    snd_pcm_sw_params_free (sw_params);
+
+    return 0;
+}
+
+int app_internal_linux_audio_init(app_t* app)
+{
     int err = 0;
     const char* pcm_name = "plughw:0,0";
 
@@ -5035,46 +6510,41 @@ int app_internal_linux_audio_init(app_t* app)
         return err;
 	}
 
-    unsigned int sample_rate = 44100;
     snd_pcm_hw_params_malloc (&hw_params);
-    snd_pcm_hw_params_any (alsa_handle, hw_params);
-    snd_pcm_hw_params_set_access (alsa_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format (alsa_handle, hw_params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_rate_near (alsa_handle, hw_params, &sample_rate, 0);
-    snd_pcm_hw_params_set_channels (alsa_handle, hw_params, 2);
-
-/*    if ((err = snd_pcm_hw_params_set_buffer_size (alsa_handle, hw_params, 4096)) < 0) {
-        app_log(app, snd_strerror (err));
-        app_fatal_error(app, "Error settting audio buffer\n");
-        return err;
-    } */
+    app->alsa_handle = alsa_handle;
+    app->alsa_hw_params = hw_params;
+    app->sound_vol = 1.0f;
+    app->sound_stats.min_headroom = -1;
 
-    if ((err = snd_pcm_hw_params (alsa_handle, hw_params)) < 0) {
-        app_log(app, APP_LOG_LEVEL_ERROR, snd_strerror (err));
+    if ((err = app_internal_linux_audio_configure(app, 0)) < 0) {
         app_fatal_error(app, "Error setting audio parameters\n");
         return err;
     }
 
-    snd_async_handler_t *ahandler;
-    snd_async_add_pcm_handler(&ahandler, alsa_handle, app_internal_linux_audio_output_cb, app);
-
     if ((err = snd_pcm_prepare (alsa_handle)) < 0) {
         app_log(app, APP_LOG_LEVEL_ERROR, snd_strerror (err));
         app_fatal_error(app, "Error preparing audio interface\n");
         return err;
     }
 
-    app->alsa_handle = alsa_handle;
-    app->alsa_hw_params = hw_params;
-
     return err;
 }
 
 void app_internal_linux_audio_shutdown(app_t* app)
 {
+    if(app->alsa_handle == NULL)
+        return;
+
+    app_internal_linux_audio_stop_thread(app);
+
+    if(app->audio_buffer != NULL)
+        APP_FREE(app->memctx, app->audio_buffer);
+    app->audio_buffer = NULL;
+
     snd_pcm_hw_params_free( app->alsa_hw_params );
 
     snd_pcm_close (app->alsa_handle);
+    app->alsa_handle = NULL;
 }
 
 int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, void* logctx, void* fatalctx )
@@ -5086,9 +6556,24 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     app->memctx = memctx;
     app->logctx = logctx;
     app->fatalctx = fatalctx;
+#ifdef APP_X11_SHM
+    app->interpolation = APP_INTERPOLATION_NONE;
+#else
     app->interpolation = APP_INTERPOLATION_LINEAR;
+#endif
     app->screenmode = APP_SCREENMODE_FULLSCREEN;
 
+    // non-blocking both ways: the sound thread must never stall on it, and app_wait drains it until it's empty
+    if( pipe( app->wake_pipe ) == 0 )
+    {
+        fcntl( app->wake_pipe[ 0 ], F_SETFL, O_NONBLOCK );
+        fcntl( app->wake_pipe[ 1 ], F_SETFL, O_NONBLOCK );
+    }
+    else
+    {
+        app->wake_pipe[ 0 ] = app->wake_pipe[ 1 ] = -1;
+    }
+
     // Log start message
     char msg[ 64 ];
     time_t t = time( NULL );
@@ -5127,6 +6612,14 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     app->is_minimized = false;
     app->initialized = false;
    
+#ifdef APP_X11_SHM
+    app_internal_linux_audio_init(app);
+    
+    result = app_proc( app, user_data ); 
+
+init_failed:
+    app_internal_x11_image_free( app );
+#else
     // Bind opengl functions
     app->gl.glCreateShader = ( APP_GLuint (APP_GLCALLTYPE*) (APP_GLenum) ) (uintptr_t) glXGetProcAddressARB( "glCreateShader" );
     app->gl.glShaderSource = ( void (APP_GLCALLTYPE*) (APP_GLuint, APP_GLsizei, APP_GLchar const* const*, APP_GLint const*) ) (uintptr_t) glXGetProcAddressARB( "glShaderSource" );
@@ -5156,6 +6649,8 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     app->gl.glUniform3f = ( void (APP_GLCALLTYPE*) (APP_GLint, APP_GLfloat, APP_GLfloat, APP_GLfloat) ) (uintptr_t) glXGetProcAddressARB( "glUniform3f" );
     app->gl.glGetUniformLocation = ( APP_GLint (APP_GLCALLTYPE*) (APP_GLuint, APP_GLchar const*) ) (uintptr_t) glXGetProcAddressARB( "glGetUniformLocation" );
     app->gl.glTexImage2D = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLint, APP_GLsizei, APP_GLsizei, APP_GLint, APP_GLenum, APP_GLenum, void const*) ) (uintptr_t) glXGetProcAddressARB( "glTexImage2D" );
+    app->gl.glTexSubImage2D = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLint, APP_GLint, APP_GLsizei, APP_GLsizei, APP_GLenum, APP_GLenum, void const*) ) (uintptr_t) glXGetProcAddressARB( "glTexSubImage2D" );
+    app->gl.glBufferSubData = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLintptr, APP_GLsizeiptr, void const*) ) (uintptr_t) glXGetProcAddressARB( "glBufferSubData" );
     app->gl.glClearColor = ( void (APP_GLCALLTYPE*) (APP_GLfloat, APP_GLfloat, APP_GLfloat, APP_GLfloat) ) (uintptr_t) glXGetProcAddressARB( "glClearColor" );
     app->gl.glClear = ( void (APP_GLCALLTYPE*) (APP_GLbitfield) ) (uintptr_t) glXGetProcAddressARB( "glClear" );
     app->gl.glDrawArrays = ( void (APP_GLCALLTYPE*) (APP_GLenum, APP_GLint, APP_GLsizei) ) (uintptr_t) glXGetProcAddressARB( "glDrawArrays" );
@@ -5182,7 +6677,10 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
 
 init_failed:
     if( !app_internal_opengl_term( &app->gl ) ) app_log( app, APP_LOG_LEVEL_WARNING, "Failed to terminate OpenGL" );
+#endif
     app_internal_linux_audio_shutdown(app);
+    if( app->wake_pipe[ 0 ] >= 0 ) close( app->wake_pipe[ 0 ] );
+    if( app->wake_pipe[ 1 ] >= 0 ) close( app->wake_pipe[ 1 ] );
 
     t = time( NULL );
     struct tm* end = localtime( &t );
@@ -5219,6 +6717,29 @@ app_state_t app_yield( app_t* app )
     return app->closed ? APP_STATE_EXIT_REQUESTED : APP_STATE_NORMAL;
 }
 
+app_state_t app_wait( app_t* app, int timeout_ms, int wake_on_sound )
+{
+    // nothing to wait for before the window is shown, or while there are events already queued. XPending also 
+    // flushes our own requests, so the server has everything it needs to answer them before we go to sleep
+    if( app->initialized && !app->closed && XPending( app->display ) == 0 )
+    {
+        struct pollfd fds[ 2 ];
+        fds[ 0 ].fd = ConnectionNumber( app->display );
+        fds[ 0 ].events = POLLIN;
+        fds[ 1 ].fd = app->wake_pipe[ 0 ]; // poll skips it if the pipe couldn't be created
+        fds[ 1 ].events = POLLIN;
+
+        __atomic_store_n( &app->wake_on_sound, wake_on_sound ? 1 : 0, __ATOMIC_RELEASE );
+        poll( fds, 2, timeout_ms < 0 ? -1 : timeout_ms );
+        __atomic_store_n( &app->wake_on_sound, 0, __ATOMIC_RELEASE );
+
+        char drain[ 64 ];
+        if( fds[ 1 ].fd >= 0 )
+            while( read( fds[ 1 ].fd, drain, sizeof( drain ) ) > 0 ) { }
+    }
+    return app_yield( app );
+}
+
 void app_cancel_exit( app_t* app ) 
 {
     app->closed = false;
@@ -5319,7 +6840,12 @@ void app_interpolation( app_t* app, app_interpolation_t interpolation )
     app_internal_add_input_event( app, &input_event );
  */
     
+#ifdef APP_X11_SHM
+    // the image is only ever scaled by whole pixels
+    app->interpolation = APP_INTERPOLATION_NONE;
+#else
     app_internal_opengl_interpolation( &app->gl, interpolation );
+#endif
 }
 
 void app_internal_x11_set_fullscreen(app_t* app, bool fullscreen)
@@ -5351,12 +6877,12 @@ void app_screenmode( app_t* app, app_screenmode_t screenmode )
     {
         app_internal_x11_set_fullscreen(app, false);
         XResizeWindow(app->display, app->window, app->windowed_w, app->windowed_h);
-        app_internal_opengl_resize( &app->gl, app->windowed_w, app->windowed_h );
+        app_internal_x11_view_resize( app, app->windowed_w, app->windowed_h );
     }
     else if(screenmode == APP_SCREENMODE_FULLSCREEN)
     {
         app_internal_x11_set_fullscreen(app, true);
-        app_internal_opengl_resize( &app->gl, app->fullscreen_width, app->fullscreen_height );
+        app_internal_x11_view_resize( app, app->fullscreen_width, app->fullscreen_height );
     }
 }
 
@@ -5367,7 +6893,7 @@ void app_window_size( app_t* app, int width, int height )
     if(app->screenmode == APP_SCREENMODE_WINDOW)
     {
         XResizeWindow(app->display, app->window, width, height);
-        app_internal_opengl_resize( &app->gl, width, height );
+        app_internal_x11_view_resize( app, width, height );
     }
 }
 
@@ -5406,15 +6932,80 @@ app_displays_t app_displays( app_t* app )
     return displays;
 }
 
-void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr ) 
-{ 
+void app_present_rows( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, 
+    APP_U32 border_xbgr, int first_row, int row_count )
+{
+#ifdef APP_X11_SHM
     if( pixels_xbgr != NULL ) 
-        app_internal_opengl_present( &app->gl, pixels_xbgr, width, height, mod_xbgr, border_xbgr );
+        app_internal_x11_present( app, pixels_xbgr, width, height, mod_xbgr, border_xbgr, first_row, row_count );
+#else
+    if( pixels_xbgr != NULL ) 
+        app_internal_opengl_present( &app->gl, pixels_xbgr, width, height, mod_xbgr, border_xbgr, first_row, row_count );
     glXSwapBuffers ( app->display, app->window );
+#endif
+}
+
+void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr ) 
+{ 
+    app_present_rows( app, pixels_xbgr, width, height, mod_xbgr, border_xbgr, 0, height );
+}
+
+static void app_internal_linux_audio_callback(app_t* app, int sample_pairs_count, 
+    void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), 
+    void (*sound_callback_f)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data)
+{
+    if(app->alsa_handle == NULL)
+        return;
+
+    app_internal_linux_audio_stop_thread(app);
+    app->sound_callback = NULL;
+    app->sound_callback_f = NULL;
+    app->sound_user_data = NULL;
+
+    if((!sound_callback && !sound_callback_f) || !sample_pairs_count)
+        return;
+
+    if(app->audio_buffer != NULL)
+    {
+        APP_FREE(app->memctx, app->audio_buffer);
+        app->audio_buffer = NULL;
+        app->audio_buffer_size = 0;
+    }
+
+    // the device buffer takes the place of the looping stream buffer used on windows, and the callback decides the format
+    app->sound_callback = sound_callback;
+    app->sound_callback_f = sound_callback_f;
+    app->sound_user_data = user_data;
+    if(app_internal_linux_audio_configure(app, sample_pairs_count) < 0)
+    {
+        app->sound_callback = NULL;
+        app->sound_callback_f = NULL;
+        app->sound_user_data = NULL;
+        return;
+    }
+    app_internal_linux_audio_start_thread(app);
+}
+
+void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+{
+    app_internal_linux_audio_callback(app, sample_pairs_count, sound_callback, NULL, user_data);
+}
+
+void app_sound_f( app_t* app, int sample_pairs_count, void (*sound_callback)( float* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data )
+{
+    app_internal_linux_audio_callback(app, sample_pairs_count, NULL, sound_callback, user_data);
 }
 
 void app_sound_buffer_size( app_t* app, int sample_pairs_count ) 
 {
+    if(app->alsa_handle == NULL)
+        return;
+
+    app_internal_linux_audio_stop_thread(app);
+    app->sound_callback = NULL;
+    app->sound_callback_f = NULL;
+    app->sound_user_data = NULL;
+
     if(app->audio_buffer != NULL)
     {
         APP_FREE(app->memctx, app->audio_buffer);
@@ -5426,17 +7017,13 @@ void app_sound_buffer_size( app_t* app, int sample_pairs_count )
         app->audio_buffer_position = 0;
         app->audio_buffer = APP_MALLOC(app->memctx, sample_pairs_count * 2 * sizeof(short));
         memset(app->audio_buffer, 0x00, sample_pairs_count * 2 * sizeof(short));
-        
-        snd_pcm_prepare (app->alsa_handle);
-        
-        unsigned int avail = snd_pcm_avail_update(app->alsa_handle);
-        if(avail > sample_pairs_count)
-            avail = sample_pairs_count;
-        snd_pcm_writei(app->alsa_handle, app->audio_buffer, avail);
+
+        if(app_internal_linux_audio_configure(app, 0) < 0)
+            return;
+        app_internal_linux_audio_start_thread(app);
     }
     else
     {
-        snd_pcm_drop(app->alsa_handle);
         app->audio_buffer_size = 0;
         app->audio_buffer = NULL;
     }
@@ -5451,10 +7038,6 @@ void app_sound_write( app_t* app, int sample_pairs_offset, int sample_pairs_coun
 {
     if(app->audio_buffer == NULL)
         return;
-    
-    snd_pcm_state_t alsa_state = snd_pcm_state(app->alsa_handle);
-    if(alsa_state != SND_PCM_STATE_PREPARED && alsa_state != SND_PCM_STATE_RUNNING)
-        snd_pcm_prepare (app->alsa_handle);
 
     APP_S16* buffer = &app->audio_buffer[sample_pairs_offset * 2];
     for(int i=0; i<sample_pairs_count * 2; ++i)
@@ -5470,6 +7053,49 @@ void app_sound_volume( app_t* app, float volume )
     app->sound_vol = volume;
 }
 
+void app_sound_latency( app_t* app, int latency_us, int period_size, int period_count )
+{
+    app->sound_latency_us = latency_us;
+    app->sound_period_size = period_size;
+    app->sound_period_count = period_count;
+    if(app->alsa_handle == NULL)
+        return;
+
+    bool was_running = app->sound_thread_running;
+    app_internal_linux_audio_stop_thread(app);
+    if(app_internal_linux_audio_configure(app, app->sound_params.buffer_size) < 0)
+        return;
+    if(was_running)
+        app_internal_linux_audio_start_thread(app);
+}
+
+app_sound_params_t app_sound_params( app_t* app )
+{
+    return app->sound_params;
+}
+
+app_sound_stats_t app_sound_stats( app_t* app )
+{
+    app_sound_stats_t stats;
+    stats.underruns = __atomic_load_n(&app->sound_stats.underruns, __ATOMIC_RELAXED);
+    stats.recoveries = __atomic_load_n(&app->sound_stats.recoveries, __ATOMIC_RELAXED);
+    stats.late_refills = __atomic_load_n(&app->sound_stats.late_refills, __ATOMIC_RELAXED);
+    stats.min_headroom = __atomic_load_n(&app->sound_stats.min_headroom, __ATOMIC_RELAXED);
+    return stats;
+}
+
+void app_sound_stats_reset( app_t* app )
+{
+    // the sound thread owns the counters, so ask it to clear them next time it wakes up
+    if(app->sound_thread_running)
+    {
+        __atomic_store_n(&app->sound_stats_reset, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    memset(&app->sound_stats, 0, sizeof(app->sound_stats));
+    app->sound_stats.min_headroom = -1;
+}
+
 app_input_t app_input( app_t* app )
 {
     app_input_t input;
@@ -14,58 +14,418 @@
 #define XUI_IMPLEMENTATION
 #include "xui.h"
 
+#ifdef _WIN32
+#include <intrin.h>
+#define atomic_exchange_int(ptr, value) _InterlockedExchange((long volatile*)(ptr), (long)(value))
+#define atomic_load_int(ptr) _InterlockedOr((long volatile*)(ptr), 0)
+#else
+#define atomic_exchange_int(ptr, value) __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+#define atomic_load_int(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#endif
+
 int AppWidth = 480;
 int AppHeight = 320;
+bool ShowSoundStats = true;	// toggled with F1
+bool SmoothScroll = false;	// toggled with F2
+bool ShowScopes = true;		// toggled with F3
+int BackgroundCol = 0xff806040;
+int DrawThreads = 1;	// threads to draw the ui on, only worth raising for big window sizes
+
+enum
+{
+	PLAYER_COMMAND_NONE,
+	PLAYER_COMMAND_PLAY,
+	PLAYER_COMMAND_STOP,
+};
+
+#define RENDER_LOAD_BUCKETS 11	// 10% steps, the last one is for blocks that took longer than they last
+
+// how long rendering takes, as a percentage of the time the rendered sound lasts
+typedef struct render_load
+{
+	float load;		// of the latest block
+	float average;
+	float peak;
+	unsigned int histogram[RENDER_LOAD_BUCKETS];
+} render_load;
+
+// where the player is and how hard it's working, as published by the sound thread for the ui to draw
+typedef struct player_status
+{
+	int pattern_idx;	// index into the pattern table
+	int pattern;		// the pattern being played
+	int line_idx;
+	float line_fraction;	// how far playback is into the line
+	float line_seconds;		// how long the line lasts, 0 when not playing
+	APP_U64 time_count;		// when this was published
+	render_load load;
+	mp_scopes scopes;		// levels since the last status, flat when the scopes are off
+} player_status;
+
+#define PLAYER_STATUS_FRESH 4
+
+// once playback has started the mod player belongs to the sound thread, which renders it from the sound callback.
+// the ui only talks to it through pending_command, and reads the player status from a triple buffer:
+// the sound thread fills statuses[back] and swaps it into middle, the ui swaps middle with front when it
+// has the PLAYER_STATUS_FRESH bit set. neither side ever waits for the other.
+typedef struct player_context
+{
+	app_t* app;
+	mp_mod_player* modplayer;
+	int sample_rate;
+	int pending_command;
+	int show_scopes;	// set by the ui, the sound thread turns the mixer's scope taps on and off to match
+	render_load load;	// owned by the sound thread
+	player_status statuses[3];
+	int back;
+	int middle;
+	int front;
+} player_context;
+
+void player_publish_status(player_context* ctx)
+{
+	player_status* status = &ctx->statuses[ctx->back];
+	status->pattern_idx = ctx->modplayer->pattern_idx;
+	status->pattern = ctx->modplayer->mod->pattern_table[ctx->modplayer->pattern_idx];
+	status->line_idx = ctx->modplayer->line_idx;
+	status->load = ctx->load;
+	modplayer_read_scopes(ctx->modplayer, &status->scopes);
+
+	// lets the ui move smoothly between lines, even though this only runs once per sound block
+	mp_mod_player* modplayer = ctx->modplayer;
+	status->line_fraction = 0.0f;
+	status->line_seconds = 0.0f;
+	status->time_count = app_time_count(ctx->app);
+	if(modplayer->play_state != PLAY_NONE && modplayer->bpm > 0)
+	{
+		float tick_frames = modplayer->output_sample_rate / (0.4f * modplayer->bpm);
+		float line_frames = (modplayer->speed + modplayer->pattern_delay) * tick_frames;
+		float frames_into_line = (modplayer->tick_idx + 1) * tick_frames - modplayer->frames_until_next_tick;
+		status->line_fraction = frames_into_line / line_frames;
+		status->line_seconds = line_frames / modplayer->output_sample_rate;
+	}
+
+	ctx->back = atomic_exchange_int(&ctx->middle, ctx->back | PLAYER_STATUS_FRESH) & ~PLAYER_STATUS_FRESH;
+}
+
+const player_status* player_latest_status(player_context* ctx)
+{
+	if(atomic_load_int(&ctx->middle) & PLAYER_STATUS_FRESH)
+		ctx->front = atomic_exchange_int(&ctx->middle, ctx->front) & ~PLAYER_STATUS_FRESH;
+	return &ctx->statuses[ctx->front];
+}
+
+void render_load_add(render_load* load, double render_seconds, double block_seconds)
+{
+	load->load = (float)(100.0 * render_seconds / block_seconds);
+	load->average += (load->load - load->average) * 0.05f;
+	if(load->load > load->peak)
+		load->peak = load->load;
+
+	int bucket = (int)(load->load / 10.0f);
+	load->histogram[bucket < RENDER_LOAD_BUCKETS - 1 ? bucket : RENDER_LOAD_BUCKETS - 1]++;
+}
+
+void player_init(player_context* ctx, app_t* app, mp_mod_player* modplayer)
+{
+	memset(ctx, 0x00, sizeof(*ctx));
+	ctx->app = app;
+	ctx->modplayer = modplayer;
+	ctx->back = 0;
+	ctx->middle = 1;
+	ctx->front = 2;
+	ctx->show_scopes = ShowScopes;
+	player_publish_status(ctx);
+	player_latest_status(ctx);
+}
 
-void draw_ui(xui_gfx* gfx, mp_mod_player* modplayer)
+// runs on the sound thread
+void player_sound_callback(float* sample_pairs, int sample_pairs_count, void* user_data)
 {
-	xui_clear(gfx, 0xff806040);
+	player_context* ctx = (player_context*)user_data;
+
+	// render at whatever rate the sound device runs at, so the only resampling is the player's own
+	int sample_rate = app_sound_params(ctx->app).sample_rate;
+	if(sample_rate > 0 && sample_rate != ctx->sample_rate)
+	{
+		modplayer_set_sample_rate(ctx->modplayer, sample_rate);
+		ctx->sample_rate = sample_rate;
+	}
+
+	switch(atomic_exchange_int(&ctx->pending_command, PLAYER_COMMAND_NONE))
+	{
+		case PLAYER_COMMAND_PLAY:
+			modplayer_play_song(ctx->modplayer);
+			break;
+		case PLAYER_COMMAND_STOP:
+			modplayer_stop(ctx->modplayer);
+			break;
+	}
+
+	modplayer_set_scopes(ctx->modplayer, atomic_load_int(&ctx->show_scopes) != 0);
+
+	APP_U64 render_start = app_time_count(ctx->app);
+	modplayer_decode_frames_f(ctx->modplayer, sample_pairs_count, sample_pairs);
+	APP_U64 render_end = app_time_count(ctx->app);
+	if(ctx->sample_rate > 0)
+	{
+		render_load_add(&ctx->load, (double)(render_end - render_start) / (double)app_time_freq(ctx->app),
+			(double)sample_pairs_count / ctx->sample_rate);
+	}
+
+	player_publish_status(ctx);
+}
+
+#define PATTERN_VIEW_LINE_HEIGHT 12
+#define PATTERN_VIEW_LINES 21		// on screen, the playing line in the middle
+#define PATTERN_VIEW_CACHE_SIZE 64	// rows, a power of two comfortably above the 21 on screen
+
+// a line of the pattern as it looks on screen. it is formatted and drawn once, and blitted from then on
+typedef struct pattern_row
+{
+	int pattern;
+	int line_idx;
+	int highlight;
+	unsigned int key;	// hash of all of the above and the notes on the line
+	unsigned int* pixels;
+} pattern_row;
+
+// the pattern as it's laid out on screen is kept in canvas, one line longer than the view so it can be scrolled
+// by part of a line. when playback moves on, what's in the canvas is moved rather than drawn again.
+typedef struct pattern_view
+{
+	xui_gfx row_gfx;	// rows are drawn here, then copied into the cache
+	pattern_row rows[PATTERN_VIEW_CACHE_SIZE];
+	unsigned int* canvas;	// lines canvas_top onwards, none highlighted
+	int canvas_pattern;
+	int canvas_top;
+	unsigned int canvas_keys[PATTERN_VIEW_LINES + 1];	// key of the row in each line, 0 when it needs drawing
+} pattern_view;
+
+void pattern_view_init(pattern_view* view)
+{
+	xui_init_gfx(&view->row_gfx, AppWidth, PATTERN_VIEW_LINE_HEIGHT);
+	for(int i=0; i<PATTERN_VIEW_CACHE_SIZE; ++i)
+	{
+		view->rows[i].pattern = -1;
+		view->rows[i].pixels = (unsigned int*)malloc(AppWidth * PATTERN_VIEW_LINE_HEIGHT * sizeof(unsigned int));
+	}
+	view->canvas = (unsigned int*)malloc(AppWidth * PATTERN_VIEW_LINE_HEIGHT * (PATTERN_VIEW_LINES + 1) * sizeof(unsigned int));
+	view->canvas_pattern = -1;
+	view->canvas_top = 0;
+	memset(view->canvas_keys, 0x00, sizeof(view->canvas_keys));
+}
+
+void pattern_view_destroy(pattern_view* view)
+{
+	for(int i=0; i<PATTERN_VIEW_CACHE_SIZE; ++i)
+		free(view->rows[i].pixels);
+	free(view->canvas);
+	xui_destroy_gfx(&view->row_gfx);
+}
+
+unsigned int pattern_row_key(int pattern, int line_idx, int highlight, const mp_line* line)
+{
+	unsigned int key = 2166136261u;
+	key = (key ^ (unsigned int)pattern) * 16777619u;
+	key = (key ^ (unsigned int)line_idx) * 16777619u;
+	key = (key ^ (unsigned int)highlight) * 16777619u;
+	for(int c=0; c<4; ++c)
+	{
+		const mp_channel_note* note = &line->channels[c];
+		key = (key ^ note->period) * 16777619u;
+		key = (key ^ (note->sample | (note->effect_type << 8) | (note->effect_param << 16))) * 16777619u;
+	}
+	return key;
+}
+
+// returns the row's pixels, drawing them only if the line isn't cached or its notes have changed
+const pattern_row* pattern_view_row(pattern_view* view, const mp_pattern* pattern, int pattern_no, int line_idx, int highlight)
+{
+	const mp_line* line = &pattern->lines[line_idx];
+	unsigned int key = pattern_row_key(pattern_no, line_idx, highlight, line);
+
+	// consecutive lines go in consecutive slots, so the rows on screen never evict each other
+	pattern_row* row = &view->rows[(line_idx * 2 + highlight + pattern_no * 131) & (PATTERN_VIEW_CACHE_SIZE - 1)];
+	if(row->pattern == pattern_no && row->line_idx == line_idx && row->highlight == highlight && row->key == key)
+		return row;
+
+	xui_gfx* gfx = &view->row_gfx;
+	xui_clear(gfx, BackgroundCol);
+	if(highlight)
+		xui_draw_rect(gfx, 4, 0, AppWidth-8, PATTERN_VIEW_LINE_HEIGHT, 0xffc0c0c0);
+	int text_col = highlight ? 0xff000000 : 0xffffffff;
 
 	char line_str[64];
-	line_str[0] = '\0';
+	sprintf(line_str, "%02d", line_idx);
+	xui_draw_string(gfx, 10, 2, text_col, line_str);
 
-	int line_height = 12;
-	xui_draw_rect(gfx, 4, 110 + 5*line_height, AppWidth-8, line_height, 0xffc0c0c0);
+	for(int c=0; c<4; ++c)
+	{
+		mp_channel_note note = line->channels[c];
+		if(note.period != 0)
+			sprintf(line_str, "%03d ", note.period);
+		else
+			sprintf(line_str, "... ");
+		if(note.sample != 0)
+			sprintf(line_str + 4, "%02X ", note.sample);
+		else
+			sprintf(line_str + 4, ".. ");
+		if(note.effect_type != 0 || note.effect_param != 0)
+			sprintf(line_str + 7, "%03X", (note.effect_type << 8) | note.effect_param);
+		else
+			sprintf(line_str + 7, "...");
+
+	//	sprintf(line_str, "%03d %02X %03X", note.period, note.sample, (note.effect_type << 8) | note.effect_param);
+		xui_draw_string(gfx, 40 + 110 * c, 2, text_col, line_str);
+	}
 
-	if(xui_label_button(XID, "PLAY", 100, 18))
-		modplayer_play_song(modplayer);
-	if(xui_label_button(XID, "STOP", 200, 18))
-		modplayer_stop(modplayer);
+	memcpy(row->pixels, gfx->pixels, AppWidth * PATTERN_VIEW_LINE_HEIGHT * sizeof(unsigned int));
+	row->pattern = pattern_no;
+	row->line_idx = line_idx;
+	row->highlight = highlight;
+	row->key = key;
+	return row;
+}
 
-	mp_pattern pattern = modplayer->mod->patterns[modplayer->mod->pattern_table[modplayer->pattern_idx]];
-	int active_line = modplayer->line_idx;
-	for(int i=active_line - 10; i <= active_line + 10; ++i)
+// makes the canvas start at top_line, and returns a key for what's in it
+unsigned int pattern_view_scroll_to(pattern_view* view, const mp_pattern* pattern, int pattern_no, int top_line)
+{
+	int canvas_lines = PATTERN_VIEW_LINES + 1;
+	int row_pixels = AppWidth * PATTERN_VIEW_LINE_HEIGHT;
+
+	// rows still in view are moved with a single copy, the ones that scroll in are left to be drawn
+	int shift = top_line - view->canvas_top;
+	if(view->canvas_pattern != pattern_no || shift >= canvas_lines || shift <= -canvas_lines)
+	{
+		memset(view->canvas_keys, 0x00, sizeof(view->canvas_keys));
+	}
+	else if(shift > 0)
+	{
+		memmove(view->canvas, view->canvas + shift * row_pixels, (canvas_lines - shift) * row_pixels * sizeof(unsigned int));
+		memmove(view->canvas_keys, view->canvas_keys + shift, (canvas_lines - shift) * sizeof(unsigned int));
+		memset(view->canvas_keys + canvas_lines - shift, 0x00, shift * sizeof(unsigned int));
+	}
+	else if(shift < 0)
 	{
-		if(i < 0 || i >= 64)
-			continue;
-		
-		mp_line line = pattern.lines[i];
+		memmove(view->canvas - shift * row_pixels, view->canvas, (canvas_lines + shift) * row_pixels * sizeof(unsigned int));
+		memmove(view->canvas_keys - shift, view->canvas_keys, (canvas_lines + shift) * sizeof(unsigned int));
+		memset(view->canvas_keys, 0x00, -shift * sizeof(unsigned int));
+	}
+	view->canvas_pattern = pattern_no;
+	view->canvas_top = top_line;
 
-		int text_y =  110 + 5*line_height + 2 + ((i - active_line) * line_height);
-		int text_col = i == active_line ? 0xff000000 : 0xffffffff;
+	// this also catches rows whose notes have changed
+	unsigned int canvas_key = 2166136261u;
+	for(int i=0; i<canvas_lines; ++i)
+	{
+		int line_idx = top_line + i;
+		unsigned int* pixels = view->canvas + i * row_pixels;
+		if(line_idx < 0 || line_idx >= 64)
+		{
+			if(view->canvas_keys[i] != 1)
+			{
+				for(int j=0; j<row_pixels; ++j)
+					pixels[j] = BackgroundCol;
+				view->canvas_keys[i] = 1;
+			}
+		}
+		else if(view->canvas_keys[i] != pattern_row_key(pattern_no, line_idx, 0, &pattern->lines[line_idx]))
+		{
+			const pattern_row* row = pattern_view_row(view, pattern, pattern_no, line_idx, 0);
+			memcpy(pixels, row->pixels, row_pixels * sizeof(unsigned int));
+			view->canvas_keys[i] = row->key;
+		}
+		canvas_key = (canvas_key ^ view->canvas_keys[i]) * 16777619u;
+	}
+	return canvas_key;
+}
 
-		sprintf(line_str, "%02d", i);
-		xui_draw_string(gfx, 10, text_y, text_col, line_str);
+#define SCOPE_WIDTH 32
+#define SCOPE_HEIGHT 36
 
-		for(int c=0; c<4; ++c)
+// a voice's (or the mix's) waveform, drawn as a column from the lowest to the highest point under each pixel,
+// with a meter beside it: a bar for the rms level and a line for the peak, red if it clipped
+void draw_scope(xui_gfx* gfx, int x, int y, const mp_scope* scope)
+{
+	const int points_per_column = MP_SCOPE_POINTS / SCOPE_WIDTH;
+	int mid_y = y + SCOPE_HEIGHT / 2;
+	xui_draw_rect(gfx, x, y, SCOPE_WIDTH, SCOPE_HEIGHT, 0xff402010);
+	for(int column=0; column<SCOPE_WIDTH; ++column)
+	{
+		const float* points = &scope->wave[column * points_per_column];
+		float lo = points[0], hi = points[0];
+		for(int i=1; i<points_per_column; ++i)
 		{
-			mp_channel_note note = line.channels[c];
-			if(note.period != 0)
-				sprintf(line_str, "%03d ", note.period);
-			else
-				sprintf(line_str, "... ");
-			if(note.sample != 0)
-				sprintf(line_str + 4, "%02X ", note.sample);
-			else
-				sprintf(line_str + 4, ".. ");
-			if(note.effect_type != 0 || note.effect_param != 0)
-				sprintf(line_str + 7, "%03X", (note.effect_type << 8) | note.effect_param);
-			else
-				sprintf(line_str + 7, "...");
-			
-		//	sprintf(line_str, "%03d %02X %03X", note.period, note.sample, (note.effect_type << 8) | note.effect_param);			
-			xui_draw_string(gfx, 40 + 110 * c, text_y, text_col, line_str);
+			lo = points[i] < lo ? points[i] : lo;
+			hi = points[i] > hi ? points[i] : hi;
 		}
+		int top = mid_y - (int)(hi * (SCOPE_HEIGHT / 2));
+		int bottom = mid_y - (int)(lo * (SCOPE_HEIGHT / 2)) + 1;
+		top = top < y ? y : top;
+		bottom = bottom > y + SCOPE_HEIGHT ? y + SCOPE_HEIGHT : bottom;
+		if(bottom > top)
+			xui_draw_rect(gfx, x + column, top, 1, bottom - top, 0xff40ff40);
+	}
+
+	int meter_x = x + SCOPE_WIDTH + 2;
+	int rms_height = (int)(scope->rms * SCOPE_HEIGHT);
+	int peak_height = (int)(scope->peak * SCOPE_HEIGHT);
+	rms_height = rms_height > SCOPE_HEIGHT ? SCOPE_HEIGHT : rms_height;
+	peak_height = peak_height > SCOPE_HEIGHT - 1 ? SCOPE_HEIGHT - 1 : peak_height;
+	xui_draw_rect(gfx, meter_x, y, 3, SCOPE_HEIGHT, 0xff402010);
+	xui_draw_rect(gfx, meter_x, y + SCOPE_HEIGHT - rms_height, 3, rms_height, 0xff40ff40);
+	xui_draw_rect(gfx, meter_x, y + SCOPE_HEIGHT - 1 - peak_height, 3, 1, scope->peak >= 1.0f ? 0xff0000ff : 0xffc0c0c0);
+}
+
+void draw_ui(xui_gfx* gfx, player_context* player, pattern_view* view)
+{
+	xui_clear(gfx, BackgroundCol);
+
+	if(xui_label_button(XID, "PLAY", 100, 18))
+		atomic_exchange_int(&player->pending_command, PLAYER_COMMAND_PLAY);
+	if(xui_label_button(XID, "STOP", 200, 18))
+		atomic_exchange_int(&player->pending_command, PLAYER_COMMAND_STOP);
+
+	// the pattern data itself is never modified after loading, so it can be read from here
+	const player_status* status = player_latest_status(player);
+	const mp_pattern* pattern = &player->modplayer->mod->patterns[status->pattern];
+	int active_line = status->line_idx;
+	int bar_y = 110 + 5*PATTERN_VIEW_LINE_HEIGHT;
+	unsigned int canvas_key = pattern_view_scroll_to(view, pattern, status->pattern, active_line - PATTERN_VIEW_LINES/2);
+
+	// smooth scrolling carries on from the last published position at the rate the song plays
+	int scroll_y = 0;
+	if(SmoothScroll && status->line_seconds > 0.0f)
+	{
+		double since = (double)(app_time_count(player->app) - status->time_count) / (double)app_time_freq(player->app);
+		float fraction = status->line_fraction + (float)(since / status->line_seconds);
+		scroll_y = (int)(fraction * PATTERN_VIEW_LINE_HEIGHT);
+		scroll_y = scroll_y < 0 ? 0 : scroll_y >= PATTERN_VIEW_LINE_HEIGHT ? PATTERN_VIEW_LINE_HEIGHT - 1 : scroll_y;
+	}
+
+	xui_draw_bitmap(gfx, 0, bar_y - (PATTERN_VIEW_LINES/2) * PATTERN_VIEW_LINE_HEIGHT, AppWidth,
+		PATTERN_VIEW_LINES * PATTERN_VIEW_LINE_HEIGHT, view->canvas + scroll_y * AppWidth, canvas_key + scroll_y);
+
+	// the lines move under a fixed bar when scrolling smoothly, otherwise the playing line is drawn highlighted
+	if(SmoothScroll)
+	{
+		xui_draw_rect_blend(gfx, 4, bar_y, AppWidth-8, PATTERN_VIEW_LINE_HEIGHT, 0x80c0c0c0);
+	}
+	else
+	{
+		const pattern_row* row = pattern_view_row(view, pattern, status->pattern, active_line, 1);
+		xui_draw_bitmap(gfx, 0, bar_y, AppWidth, PATTERN_VIEW_LINE_HEIGHT, row->pixels, row->key);
+	}
+
+	// the voices, then the mix, right of the buttons
+	if(atomic_load_int(&player->show_scopes) != ShowScopes)
+		atomic_exchange_int(&player->show_scopes, ShowScopes);
+	if(ShowScopes)
+	{
+		for(unsigned int i=0; i<status->scopes.num_channels; ++i)
+			draw_scope(gfx, 256 + i * 44, 8, &status->scopes.channels[i]);
+		draw_scope(gfx, 256 + status->scopes.num_channels * 44, 8, &status->scopes.master);
 	}
 }
 
@@ -96,6 +456,18 @@ void handle_events(app_t* app)
             {
                 // todo: toggle edit state
             }
+			else if(event.data.key == APP_KEY_F1)
+			{
+				ShowSoundStats = !ShowSoundStats;
+			}
+			else if(event.data.key == APP_KEY_F2)
+			{
+				SmoothScroll = !SmoothScroll;
+			}
+			else if(event.data.key == APP_KEY_F3)
+			{
+				ShowScopes = !ShowScopes;
+			}
 		}
 		else if(event.type == APP_INPUT_KEY_UP)
 		{
@@ -116,66 +488,117 @@ int app_proc( app_t* app, void* user_data )
 
 	xui_gfx gfx;
 	xui_init_gfx(&gfx, AppWidth, AppHeight);
+	xui_gfx_set_threads(&gfx, DrawThreads);
 	xui_init(&gfx);
+	pattern_view view;
+	pattern_view_init(&view);
 
-	int buffer_size_in_frames = 6000;
-	int buffer_bucket_size = 1500;
-	int channel_count = 2;
-	short* buffer = (short*)malloc(sizeof(short) * channel_count * buffer_size_in_frames);
-	memset(buffer, 0x00, sizeof(short) * channel_count * buffer_size_in_frames);
+	int buffer_size_in_frames = 6000;	// size of the sound device buffer
 
 	mp_mod_player* modplayer = (mp_mod_player*)user_data;
 	modplayer_reset_song_to_beginning(modplayer);
 
 	// set some params
 	modplayer_set_stereo(modplayer, true);
-	modplayer_set_sample_rate(modplayer, 44100);
 	modplayer_set_stereo_width(modplayer, 0.5f);
+	modplayer_set_render_cache_size(modplayer, 1024 * 1024); // 4MB of cached note renders
 	// start song
 	modplayer_reset_song_to_beginning(modplayer);
 
-	// start sound playing
-	app_sound_buffer_size(app, buffer_size_in_frames);
-//	modplayer_decode_frames(modplayer, buffer_size_in_frames, buffer);
-	app_sound_write(app, 0, buffer_size_in_frames, buffer);
+	// start sound playing, from here on the mod player is only touched by the sound thread
+	player_context player;
+	player_init(&player, app, modplayer);
+	app_sound_f(app, buffer_size_in_frames, player_sound_callback, &player);
+	// for live use, something like app_sound_latency(app, 10000, 0, 2) asks for a 10ms buffer in two periods
+	app_sound_params_t sound_params = app_sound_params(app);
+	const char* format_names[] = { "16-bit", "32-bit", "float" };
+	printf("sound: %s %dhz, %d frame buffer in %d periods of %d, %.1fms latency\n", format_names[sound_params.format],
+		sound_params.sample_rate, sound_params.buffer_size, sound_params.period_count, sound_params.period_size,
+		sound_params.latency_us / 1000.0f);
 
 	APP_U64 previous_count = app_time_count(app);
 	char fps_str[64];
+	int wait_ms = 0;
+	int wake_on_sound = 0;
 
-	int prev_bucket_idx = 0;
-
-	// keep running until the user closes the window
-	while( app_yield( app ) != APP_STATE_EXIT_REQUESTED )
+	// keep running until the user closes the window, sleeping until there's something new to draw
+	while( app_wait( app, wait_ms, wake_on_sound ) != APP_STATE_EXIT_REQUESTED )
 	{
 		APP_U64 current_count = app_time_count( app );
 		APP_U64 delta_count = current_count - previous_count;
 		double delta_time = ( (double) delta_count ) / ( (double) app_time_freq( app ) );
 		previous_count = current_count;
 
-		int buffer_position = app_sound_position(app);
-		int bucket_idx = buffer_position / buffer_bucket_size;
-		if(bucket_idx != prev_bucket_idx)
-		{
-			int num_frames = buffer_bucket_size;
-			modplayer_decode_frames(modplayer, num_frames, buffer);
-			app_sound_write(app, prev_bucket_idx * buffer_bucket_size, num_frames, buffer);
-			prev_bucket_idx = bucket_idx;
-		}
-
 		xui_begin_frame();
+		xui_gfx_begin_frame(&gfx);
 		handle_events(app);
 
-		draw_ui(&gfx, modplayer);
+		draw_ui(&gfx, &player, &view);
 
 		sprintf(fps_str, "%02.2fms", 1000.0f * delta_time);
 		xui_draw_string(&gfx, 20, 20, 0xffffffff, fps_str);
 
-		// display the canvas
-		app_present( app, gfx.pixels, gfx.width, gfx.height, 0xffffff, 0x000000 );
+		// render load, and a histogram of it with each bar scaled to the most common bucket
+		const render_load* load = &player_latest_status(&player)->load;
+		sprintf(fps_str, "cpu %.1f%% pk %.1f%%", load->average, load->peak);
+		xui_draw_string(&gfx, 20, 32, 0xffffffff, fps_str);
+		unsigned int most = 1;
+		for(int i=0; i<RENDER_LOAD_BUCKETS; ++i)
+			most = load->histogram[i] > most ? load->histogram[i] : most;
+		for(int i=0; i<RENDER_LOAD_BUCKETS; ++i)
+		{
+			int bar_height = (int)(16 * (unsigned long long)load->histogram[i] / most);
+			unsigned int bar_col = i == RENDER_LOAD_BUCKETS - 1 ? 0xff0000ff : 0xffc0c0c0;
+			xui_draw_rect(&gfx, 140 + i * 4, 44 - bar_height, 3, bar_height, bar_col);
+		}
+
+		if(ShowSoundStats)
+		{
+			char stats_str[64];
+			app_sound_stats_t stats = app_sound_stats(app);
+			int sample_rate = app_sound_params(app).sample_rate;
+			if(stats.min_headroom >= 0 && sample_rate > 0)
+				sprintf(stats_str, "xrun %d rec %d late %d min %.1fms", stats.underruns, stats.recoveries,
+					stats.late_refills, 1000.0f * stats.min_headroom / sample_rate);
+			else
+				sprintf(stats_str, "xrun %d rec %d late %d min --", stats.underruns, stats.recoveries, stats.late_refills);
+			xui_draw_string(&gfx, 20, AppHeight - 14, 0xffffffff, stats_str);
+		}
+
+		// draws only what changed since last frame
+		int damage_count = xui_gfx_end_frame(&gfx);
+
+		// display the canvas, sending only the rows that changed
+		int first_row = gfx.height, last_row = 0;
+		for(int i=0; i<damage_count; ++i)
+		{
+			first_row = gfx.damage[i].y < first_row ? gfx.damage[i].y : first_row;
+			last_row = gfx.damage[i].y + gfx.damage[i].h > last_row ? gfx.damage[i].y + gfx.damage[i].h : last_row;
+		}
+		app_present_rows( app, gfx.pixels, gfx.width, gfx.height, 0xffffff, 0x000000, first_row,
+			damage_count > 0 ? last_row - first_row : 0 );
+
+		// a playing song moves on each time the sound thread renders a period (as does one that's about to start or
+		// stop), smooth scrolling wants every display refresh (the swap blocks on vsync where it's on, otherwise
+		// pace it to 60hz), and when nothing is moving there's only input to wait for, plus the odd stats refresh
+		bool playing = player_latest_status(&player)->line_seconds > 0.0f;
+		bool changing = atomic_load_int(&player.pending_command) != PLAYER_COMMAND_NONE;
+		if(playing && !changing && SmoothScroll)
+		{
+			double frame_time = (double)(app_time_count(app) - current_count) / (double)app_time_freq(app);
+			wait_ms = frame_time < 1.0 / 60.0 ? (int)(1000.0 * (1.0 / 60.0 - frame_time)) : 0;
+			wake_on_sound = 0;
+		}
+		else
+		{
+			wait_ms = 500;
+			wake_on_sound = playing || changing;
+		}
 	}
 
-	free(buffer);
+	app_sound_f(app, 0, NULL, NULL);
 
+	pattern_view_destroy(&view);
 	xui_destroy_gfx(&gfx);
 	xui_shutdown();
 	return 0;
@@ -56,7 +56,8 @@ mp_mod_player* modplayer_create_from_buffer(unsigned char* buf, unsigned int buf
 // free a previously created mp_mod_player struct
 void modplayer_free(mp_mod_player* modplayer);
 
-// set the output sample rate. default is 48000
+// set the output sample rate. default is 48000. this can be changed while playing (e.g. to match the rate the sound
+// device ended up running at), playback continues from the same point at the same speed and pitch.
 void modplayer_set_sample_rate(mp_mod_player* modplayer, unsigned int sample_rate);
 // set the number of channels to output. default is 2 channels (i.e. stereo)
 void modplayer_set_stereo(mp_mod_player* modplayer, bool is_stereo);
@@ -65,6 +66,39 @@ void modplayer_set_stereo(mp_mod_player* modplayer, bool is_stereo);
 // this might be too wide, so you can reduce it by passing a value <1 to this function
 // the default is 1.0 (hard panning), 0.0 would result in a mono output (both channels the same)
 void modplayer_set_stereo_width(mp_mod_player* modplayer, float stereo_width);
+// optionally cache the resampled output of notes that play at a constant pitch (e.g. drum hits), so playing the
+// same sample at the same period again is just a scaled copy. max_frames is the total size of the cache (4 bytes per
+// frame), all allocated by this call, so nothing is allocated while playing. least recently used renders are dropped
+// when it's full. default is 0 (cache disabled).
+void modplayer_set_render_cache_size(mp_mod_player* modplayer, unsigned int max_frames);
+
+// each scope keeps MP_SCOPE_POINTS points of waveform, one every MP_SCOPE_DECIMATION output frames
+#define MP_SCOPE_POINTS 128
+#define MP_SCOPE_DECIMATION 8
+#define MP_SCOPE_MAX_CHANNELS 4
+
+// levels and the latest stretch of waveform, as measured while mixing. see modplayer_read_scopes()
+typedef struct mp_scope
+{
+	float peak;		// largest absolute sample value
+	float rms;
+	float wave[MP_SCOPE_POINTS];	// oldest first. stereo is averaged down to mono
+} mp_scope;
+
+typedef struct mp_scopes
+{
+	unsigned int num_channels;
+	mp_scope channels[MP_SCOPE_MAX_CHANNELS];	// each voice at its volume, before panning
+	mp_scope master;	// the mixed output
+} mp_scopes;
+
+// optionally measure each voice and the mixed output while rendering, for oscilloscopes and level meters.
+// default is false, which costs the mixer nothing. the output is exactly the same either way.
+void modplayer_set_scopes(mp_mod_player* modplayer, bool enabled);
+// copy out the levels measured since the last call along with the latest waveforms, and start measuring afresh.
+// call it between blocks from the thread doing the decoding, and pass the copy on to other threads from there.
+// if nothing was rendered since the last call the levels are 0 and the waveforms flat.
+void modplayer_read_scopes(mp_mod_player* modplayer, mp_scopes* scopes);
 
 // reset the song to the start
 void modplayer_reset_song_to_beginning(mp_mod_player* modplayer);
@@ -72,6 +106,16 @@ void modplayer_play_song(mp_mod_player* modplayer);
 void modplayer_play_pattern(mp_mod_player* modplayer);
 void modplayer_stop(mp_mod_player* modplayer);
 
+// save the complete playback state (settings, song position and channel state) into a plain block of memory of
+// modplayer_snapshot_size() bytes. restoring it later with modplayer_restore() continues playback from exactly the
+// same point, sample for sample. snapshots can be copied around or saved to disk, but are only valid for the same mod.
+// the output format belongs to the sound device rather than the song, so restoring keeps the player's current sample
+// rate and channel count (and is only sample-exact when the rate is the one the snapshot was saved at).
+unsigned int modplayer_snapshot_size(void);
+void modplayer_snapshot(mp_mod_player* modplayer, void* snapshot);
+// returns false (and leaves the player untouched) if the snapshot doesn't look valid for this player
+bool modplayer_restore(mp_mod_player* modplayer, const void* snapshot);
+
 // decode a given number of frames and write them to the given buffer.
 // the buffer should be large enough to contain frame_count*2 samples (if stereo), or frame_count samples (if mono).
 // the frames are output as interleaved (left,right) signed 16-bit integers.
@@ -91,6 +135,12 @@ void modplayer_decode_frames_f(mp_mod_player* modplayer, unsigned int frame_coun
 #include <stdlib.h>
 #include <string.h>
 
+// the scope taps measure levels four samples at a time where SSE2 is available
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MP_SSE2
+#endif
+
 typedef struct mp_pattern mp_pattern;
 typedef struct mp_line mp_line;
 typedef struct mp_channel_note mp_channel_note;
@@ -108,6 +158,11 @@ struct mp_sample
 	unsigned char volume;
 	char name[23];
 	float* sample_data;
+
+	// loop region used by the mixer. normally the same as repeat_offset/repeat_length, but very short loops (and loops
+	// that don't run to the end of the sample) are copied after the end of the sample data. see mix_loop_copy_length()
+	int mix_loop_offset;
+	int mix_loop_length;
 };
 
 struct mp_channel_note
@@ -160,6 +215,11 @@ struct mp_channel_state
 
 	float sample_pos;
 	float panning; // -1 hard left, +1 hard right
+
+	// render cache entry (index+1) this channel is playing from, 0 if none.
+	// while playing from the cache sample_pos/sample_looped aren't updated, cache_frame is the position instead
+	unsigned char cache_entry;
+	unsigned int cache_frame;
 };
 
 struct mp_mod
@@ -174,6 +234,50 @@ struct mp_mod
 	unsigned char pattern_table[128];
 };
 
+#ifndef MP_RENDER_CACHE_MAX_ENTRIES
+#define MP_RENDER_CACHE_MAX_ENTRIES 64
+#endif
+// longest render that will be cached for a note. notes that play for longer carry on through the normal mixer
+#ifndef MP_RENDER_CACHE_MAX_ENTRY_FRAMES
+#define MP_RENDER_CACHE_MAX_ENTRY_FRAMES 16384
+#endif
+
+// a sample resampled for a given period, from the start of the note at unity volume. it's rendered a bit at a time,
+// only as far as the channels playing it have got, so starting a note never costs more than a normal block.
+typedef struct mp_render_cache_entry
+{
+	unsigned char sample;
+	unsigned short period;
+	float sample_step;
+	unsigned int last_used;
+
+	unsigned int num_frames;	// rendered so far
+	float* frames;				// this entry's slot of the cache storage
+	bool complete;				// the note has ended, or filled the slot
+
+	// where the render has got to in the sample. once it's complete, the channel carries on from here without the cache
+	mp_channel_state render_state;
+} mp_render_cache_entry;
+
+typedef struct mp_render_cache
+{
+	unsigned int max_frames; // 0 = disabled
+	unsigned int slot_frames; // storage is split into num_slots slots of this many frames, one per entry
+	int num_slots;
+	float* storage;
+	unsigned int use_counter;
+	int num_entries;
+	mp_render_cache_entry entries[MP_RENDER_CACHE_MAX_ENTRIES]; // the slots of entries past num_entries are free
+} mp_render_cache;
+
+// running measurements behind an mp_scope, between calls to modplayer_read_scopes()
+typedef struct mp_scope_tap
+{
+	float peak;
+	double sum_squares;
+	float wave[MP_SCOPE_POINTS];	// ring buffer, written at scope_write
+} mp_scope_tap;
+
 typedef enum mp_play_state
 {
 	PLAY_NONE = 0,
@@ -187,7 +291,7 @@ struct mp_mod_player
 	// output sample rate in hz. default is 48000
 	unsigned int output_sample_rate;
 	// number of channels to mix to.
-	// 1=mono, 2=stereo. (other values not currently supported)
+	// 1=mono, 2=stereo. (other values not currently supported, they come out silent)
 	// default is stereo.
 	unsigned int output_channel_count;
 	// by default channels 1&4 are mixed hard left and channels 2,3 are mixed hard right
@@ -216,10 +320,46 @@ struct mp_mod_player
 	int pattern_delay; // used for pattern-delay effect (EE)
 
 	mp_channel_state* channel_state;
-	float* mix_buffer;
 	float* final_buffer;
+
+	mp_render_cache render_cache;
+
+	// scope taps, see modplayer_set_scopes(). while they're on each voice is rendered into scope_buffer on its own
+	bool scopes_enabled;
+	float* scope_buffer;
+	mp_scope_tap scope_taps[MP_SCOPE_MAX_CHANNELS + 1];	// the voices, then the master
+	unsigned int scope_frames;	// measured since the last read
+	unsigned int scope_write;	// next point in the waveform rings
+	unsigned int scope_phase;	// frames until the next waveform point is taken
 };
 
+#define MP_SNAPSHOT_VERSION 1
+
+// everything needed to continue playback, as saved by modplayer_snapshot()
+typedef struct mp_snapshot
+{
+	unsigned int version;
+	unsigned int num_channels;
+
+	unsigned int output_sample_rate;
+	unsigned int output_channel_count;
+	float stereo_width;
+
+	int play_state;
+	int pattern_idx;
+	int line_idx;
+	int tick_idx;
+	int frames_until_next_tick;
+	int speed;
+	int bpm;
+	int do_position_jump;
+	int position_jump_pat_idx;
+	int position_jump_line_idx;
+	int pattern_delay;
+
+	mp_channel_state channel_state[4]; // until we support xm
+} mp_snapshot;
+
 enum EffectType
 {
 	Effect_Arpeggio 		= 0x0,
@@ -264,6 +404,11 @@ enum ExtendedEffectType
 #define mp_max(a,b) ((a) > (b) ? (a) : (b))
 #define mp_clamp(x, a,b)  ((x) < (a) ? (a) : (x) > (b) ? (b) : (x))
 
+// loops shorter than this (in frames) are unrolled at load time until they are at least this long
+#ifndef MP_MIN_MIX_LOOP_LENGTH
+#define MP_MIN_MIX_LOOP_LENGTH 256
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265f
 #endif
@@ -302,6 +447,25 @@ static inline float mp_pow2(float x)
 	return 0.9988f + x*(0.6927f + x*(0.2503f + x*0.0572f));
 }
 
+static inline float mp_sqrt(float x)
+{
+#ifdef MP_SSE2
+	return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x)));
+#else
+	if(x <= 0.0f)
+		return 0.0f;
+
+	// halve the exponent for a first guess, then a few newton steps
+	union { float f; unsigned int i; } guess;
+	guess.f = x;
+	guess.i = 0x1fbd1df5 + (guess.i >> 1);
+	float r = guess.f;
+	r = 0.5f * (r + x / r);
+	r = 0.5f * (r + x / r);
+	return 0.5f * (r + x / r);
+#endif
+}
+
 static inline unsigned char lower_nibble(unsigned char c)
 {
 	return c & 0xf;
@@ -326,7 +490,52 @@ static void read_sample(mp_sample* sam, unsigned char* data)
 	sam->volume = data[25];
 	sam->repeat_offset = read_short_big_endian(&data[26]) * 2;
 	sam->repeat_length = read_short_big_endian(&data[28]) * 2;
+	// some mods have loops that run past the end of the sample. clip them so we never read past the sample data
+	if(sam->repeat_offset + sam->repeat_length > sam->length)
+		sam->repeat_length = mp_max(sam->length - sam->repeat_offset, 0);
 	sam->loop = sam->repeat_length > 2 ? 1 : 0;
+	sam->mix_loop_offset = sam->repeat_offset;
+	sam->mix_loop_length = sam->repeat_length;
+}
+
+// returns the number of frames of loop data to append after the end of the sample, or 0 if the loop can be played in place.
+// very short loops are unrolled to at least MP_MIN_MIX_LOOP_LENGTH frames so the mixer doesn't have to wrap every few
+// frames, and loops that end before the end of the sample are copied so the frame after the loop end is the loop start.
+static int mix_loop_copy_length(mp_sample* sam)
+{
+	if(sam->loop == 0)
+		return 0;
+
+	if(sam->repeat_length < MP_MIN_MIX_LOOP_LENGTH)
+	{
+		int num_copies = (MP_MIN_MIX_LOOP_LENGTH + sam->repeat_length - 1) / sam->repeat_length;
+		return num_copies * sam->repeat_length;
+	}
+
+	if(sam->repeat_offset + sam->repeat_length != sam->length)
+		return sam->repeat_length;
+
+	return 0;
+}
+
+// fill in the loop copy (if any) and the guard frame after the last playable frame.
+// the guard lets the mixer interpolate one frame past the end without clamping: for a looped sample it holds the
+// loop start, so the wrap is seamless, and for a one-shot it repeats the last frame.
+static void build_mix_loop(mp_sample* sam, int loop_copy_length)
+{
+	if(loop_copy_length > 0)
+	{
+		float* loop_src = &sam->sample_data[sam->repeat_offset];
+		float* loop_dst = &sam->sample_data[sam->length];
+		for(int f=0; f<loop_copy_length; ++f)
+			loop_dst[f] = loop_src[f % sam->repeat_length];
+
+		sam->mix_loop_offset = sam->length;
+		sam->mix_loop_length = loop_copy_length;
+	}
+
+	int guard_idx = sam->length + loop_copy_length;
+	sam->sample_data[guard_idx] = sam->loop > 0 ? sam->sample_data[sam->repeat_offset] : sam->sample_data[sam->length - 1];
 }
 
 static void read_pattern(mp_pattern* pat, unsigned char* data)
@@ -381,8 +590,8 @@ static mp_mod_player* modplayer_create_player(mp_mod* mod)
 
 	int num_channels = mod->num_channels;
 	modplayer->channel_state = (mp_channel_state*)malloc(sizeof(mp_channel_state) * num_channels);
-	modplayer->mix_buffer = (float*)malloc(sizeof(float) * 1024);
 	modplayer->final_buffer = (float*)malloc(sizeof(float) * 1024 * num_channels);
+	modplayer->scope_buffer = (float*)malloc(sizeof(float) * 1024);
 
 	mp_reset_channel_state(modplayer);
 
@@ -525,7 +734,10 @@ static void execute_effect(mp_mod_player* modplayer, mp_channel_note* note, mp_c
 			break;
 		case Effect_SetSampleOffset:
 			if(effect_val > 0)
+			{
 				state->sample_pos = 256.0f * effect_val;
+				state->cache_entry = 0;
+			}
 			break;
 		case Effect_VolSlide:
 		case Effect_VolSlide_Port:
@@ -549,6 +761,8 @@ static void execute_effect(mp_mod_player* modplayer, mp_channel_note* note, mp_c
 			if(!modplayer->do_position_jump) // don't overwrite pattern info from a pos-jump command on the same line
 				modplayer->position_jump_pat_idx = modplayer->pattern_idx + 1;
 			modplayer->position_jump_line_idx = effect_x * 10 + effect_y;
+			if(modplayer->position_jump_line_idx >= 64) // like protracker, a break past the end goes to the first line
+				modplayer->position_jump_line_idx = 0;
 			modplayer->do_position_jump = true;
 			break;
 		case Effect_Extended:
@@ -608,6 +822,7 @@ static void execute_line(mp_mod_player* modplayer)
 				state->sample = note->sample;
 			state->sample_pos = 0.0f;
 			state->sample_looped = 0;
+			state->cache_entry = 0;
 			state->volume = mod->samples[state->sample].volume;
 
 			if(	note->effect_type != Effect_Vibrato && 
@@ -676,7 +891,10 @@ static void execute_tick(mp_mod_player* modplayer)
 		if(state->retrigger_rate > 0)
 		{
 			if(modplayer->tick_idx % state->retrigger_rate == 0)
+			{
 				state->sample_pos = 0.0f;
+				state->cache_entry = 0;
+			}
 		}
 
 		if(state->note_cut_idx != 0 && state->note_cut_idx == modplayer->tick_idx)
@@ -687,90 +905,474 @@ static void execute_tick(mp_mod_player* modplayer)
 	modplayer->frames_until_next_tick = (int)(modplayer->output_sample_rate * seconds_per_tick);
 }
 
-static void output_channel(mp_mod_player* modplayer, mp_channel_state* state, unsigned int num_frames, float* buffer)
+static inline int channel_sample_end(mp_sample* sample, mp_channel_state* state)
+{
+	return state->sample_looped > 0 ? sample->mix_loop_offset + sample->mix_loop_length : sample->length;
+}
+
+// a channel is active while it has a valid sample and period, and hasn't run off the end of a one-shot sample.
+// inactive channels produce silence and don't need to be rendered or mixed at all.
+static bool channel_is_active(mp_mod_player* modplayer, mp_channel_state* state)
 {
 	int min_valid_period = 20; // this is to stop badly formed mods from playing sounds when they shouldn't (e.g. setting a sample but no period, then doing a pitch slide. some mods do it...)
-	if(state->sample > 0 && state->period > min_valid_period)
+	if(state->sample == 0 || state->period <= min_valid_period)
+		return false;
+
+	mp_sample* sample = &modplayer->mod->samples[state->sample];
+	if(sample->sample_data == NULL)
+		return false;
+
+	return state->sample_pos < channel_sample_end(sample, state);
+}
+
+// gains applied to a channel while mixing. volume is the channel volume (0..1), left/right are the output gains
+// for the channel's pan position (only left is used for mono output)
+typedef struct mp_mix_gains
+{
+	float volume;
+	float left;
+	float right;
+} mp_mix_gains;
+
+// a mixer kernel renders frames from sample_pos onwards, stopping after num_frames or when sample_pos reaches
+// sample_end, whichever comes first, and adds them into out_buffer. returns the number of frames processed.
+// kernels never have to deal with loops, output format or volume changes, they're picked once per channel per block.
+typedef unsigned int (*mp_mix_kernel)(const float* sample_data, float* sample_pos, float sample_step, float sample_end,
+									const mp_mix_gains* gains, float* out_buffer, unsigned int num_frames);
+
+// silent channel: just move the sample position along so it's in the right place if the volume comes back up
+static unsigned int mix_kernel_silent(const float* sample_data, float* sample_pos, float sample_step, float sample_end,
+									const mp_mix_gains* gains, float* out_buffer, unsigned int num_frames)
+{
+	(void)sample_data; (void)gains; (void)out_buffer;
+	float pos = *sample_pos;
+	unsigned int i = 0;
+	for(; i<num_frames && pos < sample_end; ++i)
+		pos += sample_step;
+
+	*sample_pos = pos;
+	return i;
+}
+
+static unsigned int mix_kernel_mono(const float* sample_data, float* sample_pos, float sample_step, float sample_end,
+									const mp_mix_gains* gains, float* out_buffer, unsigned int num_frames)
+{
+	float pos = *sample_pos;
+	float volume = gains->volume;
+	float gain = gains->left;
+	unsigned int i = 0;
+	for(; i<num_frames && pos < sample_end; ++i)
+	{
+		int idx = (int)pos;
+		float t = pos - idx;
+		// interpolate between adjacent samples. idx+1 can be sample_end, which is the guard frame set up by the loader
+		float s0 = sample_data[idx];
+		float s1 = sample_data[idx + 1];
+		float sample_val = s0 + t * (s1 - s0);
+		sample_val *= volume;
+
+		out_buffer[i] += gain * sample_val;
+		pos += sample_step;
+	}
+
+	*sample_pos = pos;
+	return i;
+}
+
+static unsigned int mix_kernel_stereo(const float* sample_data, float* sample_pos, float sample_step, float sample_end,
+									const mp_mix_gains* gains, float* out_buffer, unsigned int num_frames)
+{
+	float pos = *sample_pos;
+	float volume = gains->volume;
+	float left_gain = gains->left;
+	float right_gain = gains->right;
+	unsigned int i = 0;
+	for(; i<num_frames && pos < sample_end; ++i)
+	{
+		int idx = (int)pos;
+		float t = pos - idx;
+		float s0 = sample_data[idx];
+		float s1 = sample_data[idx + 1];
+		float sample_val = s0 + t * (s1 - s0);
+		sample_val *= volume;
+
+		out_buffer[i*2+0] += left_gain * sample_val;
+		out_buffer[i*2+1] += right_gain * sample_val;
+		pos += sample_step;
+	}
+
+	*sample_pos = pos;
+	return i;
+}
+
+static mp_mix_kernel choose_mix_kernel(mp_mod_player* modplayer, mp_channel_state* state, mp_mix_gains* gains)
+{
+	unsigned char volume = state->volume + state->vol_offset;
+	volume = mp_min(volume, 64);
+	if(volume == 0)
+		return mix_kernel_silent;
+
+	gains->volume = volume * (1.0f / 64.0f);
+
+	// the kernels write one or two samples per frame, so any other layout would come out misaligned
+	if(modplayer->output_channel_count != 1 && modplayer->output_channel_count != 2)
+		return mix_kernel_silent;
+
+	float channel_gain = modplayer->output_channel_count / (float)modplayer->mod->num_channels;
+	if(modplayer->output_channel_count == 1)
+	{
+		gains->left = channel_gain;
+		gains->right = channel_gain;
+		return mix_kernel_mono;
+	}
+
+	// simple linear panning
+	float panning = mp_clamp(state->panning * modplayer->stereo_width, -1.0f, 1.0f);
+	gains->left = channel_gain * (0.5f + 0.5f * -panning);
+	gains->right = channel_gain * (0.5f + 0.5f * panning);
+	return mix_kernel_stereo;
+}
+
+static float channel_sample_step(mp_mod_player* modplayer, mp_channel_state* state, mp_sample* sample)
+{
+	// magic formula for converting from period to sample rate: 
+	// rate in hz = Amiga chip freq / 2*period
+	float sample_rate = 7159090.5f / (state->period * 2.0f);
+	if(state->pitch_offset != 0.0f || sample->fine_tune != 0)
+	{
+		float semitones = state->pitch_offset + (sample->fine_tune * (1.0f / 8.0f));
+		sample_rate *= mp_pow2(semitones * (1.0f / 12.0f));
+	}
+	
+	return sample_rate / modplayer->output_sample_rate;
+}
+
+// run a kernel over num_frames of a channel, starting from the channel's current sample position.
+// the block is split into spans between loop wraps, so the kernel's per-frame loop never has to check for loops.
+// returns the number of frames processed, which is less than num_frames if a one-shot sample finishes.
+static unsigned int render_channel_spans(mp_sample* sample, mp_channel_state* state, float sample_step, mp_mix_kernel kernel,
+										const mp_mix_gains* gains, float* out_buffer, unsigned int out_channels, unsigned int num_frames)
+{
+	float sample_pos = state->sample_pos;
+	unsigned int frames_done = 0;
+	while(true)
+	{
+		int sample_end = channel_sample_end(sample, state);
+		frames_done += kernel(sample->sample_data, &sample_pos, sample_step, (float)sample_end, gains,
+							out_buffer + frames_done * out_channels, num_frames - frames_done);
+
+		// stopped short of the end of the sample, so the block is done
+		if(sample_pos < sample_end)
+			break;
+
+		// one-shot sample has finished, the rest of the block is silent
+		if(sample->loop == 0)
+			break;
+
+		// handle sample loop
+		float over = sample_pos - sample_end;
+		sample_pos = sample->mix_loop_offset + over;
+		state->sample_looped = 1;
+
+		if(frames_done == num_frames)
+			break;
+	}
+
+	state->sample_pos = sample_pos;
+	return frames_done;
+}
+
+// stop a channel playing from the render cache, and work out where it would have got to in the sample by replaying
+// its sample position from the start of the note. this is exactly what the mixer would have done, so the channel
+// carries on without any glitch.
+static void render_cache_unbind_channel(mp_mod_player* modplayer, mp_channel_state* state)
+{
+	mp_render_cache_entry* entry = &modplayer->render_cache.entries[state->cache_entry - 1];
+	mp_sample* sample = &modplayer->mod->samples[entry->sample];
+
+	unsigned int frames_played = state->cache_frame;
+	state->cache_entry = 0;
+	state->cache_frame = 0;
+	state->sample_pos = 0.0f;
+	state->sample_looped = 0;
+	render_channel_spans(sample, state, entry->sample_step, mix_kernel_silent, NULL, NULL, 0, frames_played);
+}
+
+static void render_cache_remove_entry(mp_mod_player* modplayer, int entry_idx)
+{
+	mp_render_cache* cache = &modplayer->render_cache;
+	int last_idx = cache->num_entries - 1;
+	for(int i=0; i<modplayer->mod->num_channels; ++i)
+	{
+		mp_channel_state* state = &modplayer->channel_state[i];
+		if(state->cache_entry == entry_idx + 1)
+			render_cache_unbind_channel(modplayer, state);
+	}
+
+	// fill the gap with the last entry, and hand the removed entry's slot to the one that's now free
+	float* slot = cache->entries[entry_idx].frames;
+	cache->entries[entry_idx] = cache->entries[last_idx];
+	cache->entries[last_idx].frames = slot;
+	cache->num_entries--;
+	for(int i=0; i<modplayer->mod->num_channels; ++i)
+	{
+		mp_channel_state* state = &modplayer->channel_state[i];
+		if(state->cache_entry == last_idx + 1)
+			state->cache_entry = entry_idx + 1;
+	}
+}
+
+static void render_cache_clear(mp_mod_player* modplayer)
+{
+	while(modplayer->render_cache.num_entries > 0)
+		render_cache_remove_entry(modplayer, modplayer->render_cache.num_entries - 1);
+}
+
+static int render_cache_find(mp_render_cache* cache, unsigned char sample, unsigned short period)
+{
+	for(int i=0; i<cache->num_entries; ++i)
 	{
-		mp_sample* sample = &modplayer->mod->samples[state->sample];
-		float sample_pos = state->sample_pos;
-		// magic formula for converting from period to sample rate: 
-		// rate in hz = Amiga chip freq / 2*period
-		float sample_rate = 7159090.5f / (state->period * 2.0f);
-		if(state->pitch_offset != 0.0f || sample->fine_tune != 0)
+		if(cache->entries[i].sample == sample && cache->entries[i].period == period)
+			return i;
+	}
+	return -1;
+}
+
+// start a new cache entry for a note, evicting the least recently used entry if all the slots are taken.
+// nothing is rendered yet, render_cache_extend() does that as the note plays. returns the new entry index.
+static int render_cache_add(mp_mod_player* modplayer, mp_channel_state* state, float sample_step)
+{
+	mp_render_cache* cache = &modplayer->render_cache;
+	if(cache->num_entries == cache->num_slots)
+	{
+		int lru_idx = 0;
+		for(int i=1; i<cache->num_entries; ++i)
 		{
-			float semitones = state->pitch_offset + (sample->fine_tune * (1.0f / 8.0f));
-			sample_rate *= mp_pow2(semitones * (1.0f / 12.0f));
+			if(cache->entries[i].last_used < cache->entries[lru_idx].last_used)
+				lru_idx = i;
 		}
-		
-		float sample_step = sample_rate / modplayer->output_sample_rate;
-		for(unsigned int i=0; i<num_frames; ++i)
+		render_cache_remove_entry(modplayer, lru_idx);
+	}
+
+	mp_render_cache_entry* entry = &cache->entries[cache->num_entries++];
+	entry->sample = state->sample;
+	entry->period = state->period;
+	entry->sample_step = sample_step;
+	entry->last_used = cache->use_counter;
+	entry->num_frames = 0;
+	entry->complete = false;
+	memset(&entry->render_state, 0x00, sizeof(mp_channel_state));
+
+	return cache->num_entries - 1;
+}
+
+// render more of a cache entry, so it has at least num_frames, or all of the note if it's shorter than that
+static void render_cache_extend(mp_mod_player* modplayer, mp_render_cache_entry* entry, unsigned int num_frames)
+{
+	unsigned int slot_frames = modplayer->render_cache.slot_frames;
+	num_frames = mp_min(num_frames, slot_frames);
+	if(entry->complete || num_frames <= entry->num_frames)
+		return;
+
+	// the render goes through the same kernel as normal playback, at unity gain, so mixing from the cache is exact.
+	// the kernel carries on from render_state, so rendering in pieces gives the same frames as rendering in one go.
+	mp_mix_gains unity_gains = { 1.0f, 1.0f, 1.0f };
+	unsigned int wanted = num_frames - entry->num_frames;
+	float* frames = &entry->frames[entry->num_frames];
+	memset(frames, 0x00, wanted * sizeof(float));
+	unsigned int rendered = render_channel_spans(&modplayer->mod->samples[entry->sample], &entry->render_state,
+												entry->sample_step, mix_kernel_mono, &unity_gains, frames, 1, wanted);
+	entry->num_frames += rendered;
+	if(rendered < wanted || entry->num_frames == slot_frames)
+		entry->complete = true;
+}
+
+// mix as much of the block as possible from the render cache. returns the number of frames mixed.
+// only notes playing from the start of the sample at a constant pitch are cached. anything that changes the pitch
+// drops the channel back to the normal mixer.
+static unsigned int mix_channel_from_cache(mp_mod_player* modplayer, mp_channel_state* state, float sample_step,
+										mp_mix_kernel kernel, const mp_mix_gains* gains, float* out_buffer,
+										unsigned int num_frames)
+{
+	mp_render_cache* cache = &modplayer->render_cache;
+	bool constant_pitch = state->pitch_offset == 0.0f && state->pitch_slide_active == 0 &&
+							state->vibrato_active == 0 && state->arpeggio_active == 0;
+
+	if(state->cache_entry != 0)
+	{
+		mp_render_cache_entry* entry = &cache->entries[state->cache_entry - 1];
+		if(entry->period != state->period || state->pitch_offset != 0.0f)
+			render_cache_unbind_channel(modplayer, state);
+	}
+	else if(constant_pitch && state->sample_pos == 0.0f && state->sample_looped == 0)
+	{
+		int entry_idx = render_cache_find(cache, state->sample, state->period);
+		if(entry_idx < 0)
+			entry_idx = render_cache_add(modplayer, state, sample_step);
+
+		state->cache_entry = (unsigned char)(entry_idx + 1);
+		state->cache_frame = 0;
+	}
+
+	if(state->cache_entry == 0)
+		return 0;
+
+	mp_render_cache_entry* entry = &cache->entries[state->cache_entry - 1];
+	entry->last_used = ++cache->use_counter;
+	render_cache_extend(modplayer, entry, state->cache_frame + num_frames);
+
+	unsigned int frames_to_mix = mp_min(num_frames, entry->num_frames - state->cache_frame);
+	const float* frames = &entry->frames[state->cache_frame];
+	if(kernel == mix_kernel_mono)
+	{
+		for(unsigned int i=0; i<frames_to_mix; ++i)
 		{
-			int sample_end = state->sample_looped > 0 ? sample->repeat_offset + sample->repeat_length : sample->length;
-		
-			if(sample_pos < sample_end)
-			{
-				int idx = (int)sample_pos;
-				float t = sample_pos - idx;
-				// interpolate between adjacent samples
-				float s0 = sample->sample_data[idx];
-				float s1 = sample->sample_data[mp_min(idx + 1, sample_end-1)];
-				float sample_val = s0 + t * (s1 - s0);
-				unsigned char volume = state->volume + state->vol_offset;
-				volume = mp_min(volume, 64);
-				sample_val *= (volume * (1.0f / 64.0f));
-									
-				buffer[i] = sample_val;
-				sample_pos += sample_step;
-
-				// handle sample loop
-				if(sample_pos >= sample_end && sample->loop > 0)
-				{
-					float over = sample_pos - sample_end;
-					sample_pos = sample->repeat_offset + over;
-					state->sample_looped = 1;
-				}
-			}
-			else
-			{
-				buffer[i] = 0.0f;
-			}			
+			float sample_val = frames[i] * gains->volume;
+			out_buffer[i] += gains->left * sample_val;
 		}
+	}
+	else if(kernel == mix_kernel_stereo)
+	{
+		for(unsigned int i=0; i<frames_to_mix; ++i)
+		{
+			float sample_val = frames[i] * gains->volume;
+			out_buffer[i*2+0] += gains->left * sample_val;
+			out_buffer[i*2+1] += gains->right * sample_val;
+		}
+	}
 
-		state->sample_pos = sample_pos;
+	state->cache_frame += frames_to_mix;
+	if(entry->complete && state->cache_frame == entry->num_frames)
+	{
+		// reached the end of the cached render, carry on from there with the normal mixer
+		state->cache_entry = 0;
+		state->sample_pos = entry->render_state.sample_pos;
+		state->sample_looped = entry->render_state.sample_looped;
 	}
-	else
+
+	return frames_to_mix;
+}
+
+// mix num_frames of a channel with the given kernel, from the render cache where possible
+static void mix_channel_frames(mp_mod_player* modplayer, mp_channel_state* state, mp_sample* sample, float sample_step,
+							mp_mix_kernel kernel, const mp_mix_gains* gains, float* out_buffer, unsigned int out_channels,
+							unsigned int num_frames)
+{
+	unsigned int frames_done = 0;
+	if(modplayer->render_cache.num_slots > 0)
+		frames_done = mix_channel_from_cache(modplayer, state, sample_step, kernel, gains, out_buffer, num_frames);
+
+	if(frames_done < num_frames)
+		render_channel_spans(sample, state, sample_step, kernel, gains, out_buffer + frames_done * out_channels, out_channels, num_frames - frames_done);
+}
+
+// peak and sum of squares of count samples, added to what's been measured so far
+static void scope_levels(const float* samples, unsigned int count, float* peak, double* sum_squares)
+{
+	float max_abs = 0.0f;
+	float sum = 0.0f;
+	unsigned int i = 0;
+#ifdef MP_SSE2
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 max4 = _mm_setzero_ps();
+	__m128 sum4 = _mm_setzero_ps();
+	for(; i+4 <= count; i+=4)
+	{
+		__m128 s = _mm_loadu_ps(&samples[i]);
+		max4 = _mm_max_ps(max4, _mm_and_ps(s, abs_mask));
+		sum4 = _mm_add_ps(sum4, _mm_mul_ps(s, s));
+	}
+
+	// fold the lanes together
+	max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(1, 0, 3, 2)));
+	max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum4 = _mm_add_ps(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum4 = _mm_add_ps(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(2, 3, 0, 1)));
+	max_abs = _mm_cvtss_f32(max4);
+	sum = _mm_cvtss_f32(sum4);
+#endif
+	for(; i<count; ++i)
 	{
-		for(unsigned int i=0; i<num_frames; ++i)
-			buffer[i] = 0.0f;
+		float abs_val = samples[i] < 0.0f ? -samples[i] : samples[i];
+		max_abs = mp_max(max_abs, abs_val);
+		sum += samples[i] * samples[i];
 	}
+
+	*peak = mp_max(*peak, max_abs);
+	*sum_squares += sum;
 }
 
-static void mix_buffer(mp_mod_player* modplayer, float* channel_buffer, float* out_buffer, unsigned int num_frames, float panning)
+// measure a block for a scope, and add its waveform points. samples is NULL for a voice that's silent all block
+static void scope_tap_add(mp_mod_player* modplayer, mp_scope_tap* tap, const float* samples, unsigned int num_frames,
+						unsigned int channels)
 {
-	float channel_gain = modplayer->output_channel_count / (float)modplayer->mod->num_channels;
+	unsigned int write = modplayer->scope_write;
+	unsigned int frame = modplayer->scope_phase;
+	if(samples == NULL)
+	{
+		for(; frame<num_frames; frame+=MP_SCOPE_DECIMATION)
+			tap->wave[write++ & (MP_SCOPE_POINTS - 1)] = 0.0f;
+		return;
+	}
 
-	if(modplayer->output_channel_count == 1)
+	scope_levels(samples, num_frames * channels, &tap->peak, &tap->sum_squares);
+	for(; frame<num_frames; frame+=MP_SCOPE_DECIMATION)
 	{
-		// mono output
-		for(unsigned int i=0; i<num_frames; ++i)
-		{
-			out_buffer[i] += channel_gain * channel_buffer[i];
-		}
+		float point = channels == 2 ? 0.5f * (samples[frame*2+0] + samples[frame*2+1]) : samples[frame];
+		tap->wave[write++ & (MP_SCOPE_POINTS - 1)] = point;
 	}
-	else if(modplayer->output_channel_count == 2)
+}
+
+// render a channel and add it into out_buffer, measuring it for tap if that isn't NULL.
+// the kernel is chosen up front for this channel's output format and volume, so the per-frame loop has no format,
+// volume or loop checks in it.
+static void mix_channel(mp_mod_player* modplayer, mp_channel_state* state, unsigned int num_frames, float* out_buffer,
+						mp_scope_tap* tap)
+{
+	if(!channel_is_active(modplayer, state))
 	{
-		// simple linear panning
-		panning = mp_clamp(panning * modplayer->stereo_width, -1.0f, 1.0f);
-		float left_gain = channel_gain * (0.5f + 0.5f * -panning);
-		float right_gain = channel_gain * (0.5f + 0.5f * panning);
-		
-		for(unsigned int i=0; i<num_frames; ++i)
+		if(tap != NULL)
+			scope_tap_add(modplayer, tap, NULL, num_frames, 1);
+		return;
+	}
+
+	mp_sample* sample = &modplayer->mod->samples[state->sample];
+	float sample_step = channel_sample_step(modplayer, state, sample);
+
+	mp_mix_gains gains;
+	mp_mix_kernel kernel = choose_mix_kernel(modplayer, state, &gains);
+
+	unsigned int out_channels = modplayer->output_channel_count;
+	if(tap != NULL && kernel != mix_kernel_silent)
+	{
+		// render the voice on its own at unit gain, measure it, then pan it into the mix. gain * (volume * sample)
+		// comes out exactly the same as mixing it directly, so the taps don't change the output
+		float* voice = modplayer->scope_buffer;
+		memset(voice, 0x00, num_frames * sizeof(float));
+		mp_mix_gains unit_gains = { gains.volume, 1.0f, 1.0f };
+		mix_channel_frames(modplayer, state, sample, sample_step, mix_kernel_mono, &unit_gains, voice, 1, num_frames);
+		scope_tap_add(modplayer, tap, voice, num_frames, 1);
+
+		if(kernel == mix_kernel_mono)
 		{
-			out_buffer[i*2+0] += left_gain * channel_buffer[i];
-			out_buffer[i*2+1] += right_gain * channel_buffer[i];
+			for(unsigned int i=0; i<num_frames; ++i)
+				out_buffer[i] += gains.left * voice[i];
 		}
+		else if(kernel == mix_kernel_stereo)
+		{
+			for(unsigned int i=0; i<num_frames; ++i)
+			{
+				out_buffer[i*2+0] += gains.left * voice[i];
+				out_buffer[i*2+1] += gains.right * voice[i];
+			}
+		}
+		return;
 	}
+
+	if(tap != NULL)
+		scope_tap_add(modplayer, tap, NULL, num_frames, 1);
+
+	mix_channel_frames(modplayer, state, sample, sample_step, kernel, &gains, out_buffer, out_channels, num_frames);
 }
 
 static void output_frames(mp_mod_player* modplayer, unsigned int num_frames, float* buffer)
@@ -781,15 +1383,27 @@ static void output_frames(mp_mod_player* modplayer, unsigned int num_frames, flo
 	unsigned int out_channels = modplayer->output_channel_count;
 	memset(buffer, 0x00, num_frames * out_channels * sizeof(float));
 	
-	for(unsigned int i=0; i<num_channels; ++i)
+	// channels are mixed straight into the output, silent and finished voices are skipped entirely
+	if(!modplayer->scopes_enabled)
 	{
-		mp_channel_state* state = &modplayer->channel_state[i];
+		for(unsigned int i=0; i<num_channels; ++i)
+			mix_channel(modplayer, &modplayer->channel_state[i], num_frames, buffer, NULL);
+		return;
+	}
 
-		memset(modplayer->mix_buffer, 0x00, num_frames * sizeof(float));
-		
-		output_channel(modplayer, state, num_frames, modplayer->mix_buffer);
-		mix_buffer(modplayer, modplayer->mix_buffer, buffer, num_frames, state->panning);
-	}				
+	for(unsigned int i=0; i<num_channels; ++i)
+	{
+		mp_scope_tap* tap = i < MP_SCOPE_MAX_CHANNELS ? &modplayer->scope_taps[i] : NULL;
+		mix_channel(modplayer, &modplayer->channel_state[i], num_frames, buffer, tap);
+	}
+	scope_tap_add(modplayer, &modplayer->scope_taps[MP_SCOPE_MAX_CHANNELS], buffer, num_frames, out_channels);
+
+	// every tap took the same points, move the rings on past them
+	unsigned int phase = modplayer->scope_phase;
+	unsigned int points = phase < num_frames ? (num_frames - phase + MP_SCOPE_DECIMATION - 1) / MP_SCOPE_DECIMATION : 0;
+	modplayer->scope_write += points;
+	modplayer->scope_phase = phase + points * MP_SCOPE_DECIMATION - num_frames;
+	modplayer->scope_frames += num_frames;
 }
 
 ////////////// Public Interface ////////////////
@@ -888,9 +1502,13 @@ mp_mod_player* modplayer_create_from_buffer(unsigned char* buf, unsigned int buf
 		if(sample->length > 0)
 		{
 			int num_frames = sample->length;
-			sample->sample_data = (float*)malloc(num_frames * sizeof(float));
+			int loop_copy_length = mix_loop_copy_length(sample);
+			// +1 for the guard frame used by the mixer's interpolation
+			sample->sample_data = (float*)malloc((num_frames + loop_copy_length + 1) * sizeof(float));
 			for(int f=0; f<num_frames; ++f)
 				sample->sample_data[f] = (1.0f / 128.0f) * sample_data[f];
+
+			build_mix_loop(sample, loop_copy_length);
 		}
 		else
 		{
@@ -908,6 +1526,9 @@ void modplayer_free(mp_mod_player* modplayer)
 	if(modplayer == NULL)
 		return;
 
+	render_cache_clear(modplayer);
+	free(modplayer->render_cache.storage);
+
 	mp_mod* mod = modplayer->mod;
 	if(mod != NULL)
 	{
@@ -924,13 +1545,21 @@ void modplayer_free(mp_mod_player* modplayer)
 	}
 
 	free(modplayer->channel_state);
-	free(modplayer->mix_buffer);
 	free(modplayer->final_buffer);
+	free(modplayer->scope_buffer);
 	free(modplayer);
 }
 
 void modplayer_set_sample_rate(mp_mod_player* modplayer, unsigned int sample_rate)
 {
+	if(sample_rate == modplayer->output_sample_rate)
+		return;
+
+	// cached renders are only valid for the sample rate they were made at
+	render_cache_clear(modplayer);
+
+	// the rest of the current tick was counted in frames at the old rate
+	modplayer->frames_until_next_tick = (int)((double)modplayer->frames_until_next_tick * sample_rate / modplayer->output_sample_rate);
 	modplayer->output_sample_rate = sample_rate;
 }
 
@@ -944,6 +1573,64 @@ void modplayer_set_stereo_width(mp_mod_player* modplayer, float stereo_width)
 	modplayer->stereo_width = stereo_width;
 }
 
+void modplayer_set_render_cache_size(mp_mod_player* modplayer, unsigned int max_frames)
+{
+	mp_render_cache* cache = &modplayer->render_cache;
+	render_cache_clear(modplayer);
+	free(cache->storage);
+	cache->storage = NULL;
+	cache->num_slots = 0;
+	cache->max_frames = max_frames;
+	if(max_frames == 0)
+		return;
+
+	// the cache runs in the sound callback, so all of its storage is allocated here, in equal slots that entries
+	// take over from each other rather than being allocated and freed
+	cache->slot_frames = mp_min(MP_RENDER_CACHE_MAX_ENTRY_FRAMES, max_frames);
+	int num_slots = mp_min(MP_RENDER_CACHE_MAX_ENTRIES, max_frames / cache->slot_frames);
+	cache->storage = (float*)malloc((size_t)num_slots * cache->slot_frames * sizeof(float));
+	if(cache->storage == NULL)
+		return;
+
+	cache->num_slots = num_slots;
+	for(int i=0; i<num_slots; ++i)
+		cache->entries[i].frames = cache->storage + i * cache->slot_frames;
+}
+
+void modplayer_set_scopes(mp_mod_player* modplayer, bool enabled)
+{
+	modplayer->scopes_enabled = enabled;
+}
+
+static void scope_tap_read(mp_mod_player* modplayer, mp_scope_tap* tap, mp_scope* scope, unsigned int sample_count)
+{
+	if(modplayer->scope_frames == 0)
+		memset(tap->wave, 0x00, sizeof(tap->wave));
+
+	scope->peak = tap->peak;
+	scope->rms = sample_count > 0 ? mp_sqrt((float)(tap->sum_squares / sample_count)) : 0.0f;
+
+	// unroll the ring, oldest point first
+	unsigned int oldest = modplayer->scope_write & (MP_SCOPE_POINTS - 1);
+	memcpy(scope->wave, &tap->wave[oldest], (MP_SCOPE_POINTS - oldest) * sizeof(float));
+	memcpy(&scope->wave[MP_SCOPE_POINTS - oldest], tap->wave, oldest * sizeof(float));
+
+	tap->peak = 0.0f;
+	tap->sum_squares = 0.0;
+}
+
+void modplayer_read_scopes(mp_mod_player* modplayer, mp_scopes* scopes)
+{
+	unsigned int num_channels = mp_min((unsigned int)modplayer->mod->num_channels, MP_SCOPE_MAX_CHANNELS);
+	scopes->num_channels = num_channels;
+	for(unsigned int i=0; i<num_channels; ++i)
+		scope_tap_read(modplayer, &modplayer->scope_taps[i], &scopes->channels[i], modplayer->scope_frames);
+	scope_tap_read(modplayer, &modplayer->scope_taps[MP_SCOPE_MAX_CHANNELS], &scopes->master,
+				modplayer->scope_frames * modplayer->output_channel_count);
+
+	modplayer->scope_frames = 0;
+}
+
 void modplayer_reset_song_to_beginning(mp_mod_player* modplayer)
 {
 	modplayer->pattern_idx = 0;
@@ -981,6 +1668,112 @@ void modplayer_stop(mp_mod_player* modplayer)
 	modplayer->play_state = PLAY_NONE;
 }
 
+unsigned int modplayer_snapshot_size(void)
+{
+	return sizeof(mp_snapshot);
+}
+
+void modplayer_snapshot(mp_mod_player* modplayer, void* snapshot)
+{
+	mp_snapshot snap;
+	memset(&snap, 0x00, sizeof(mp_snapshot));
+	snap.version = MP_SNAPSHOT_VERSION;
+	snap.num_channels = modplayer->mod->num_channels;
+
+	snap.output_sample_rate = modplayer->output_sample_rate;
+	snap.output_channel_count = modplayer->output_channel_count;
+	snap.stereo_width = modplayer->stereo_width;
+
+	snap.play_state = modplayer->play_state;
+	snap.pattern_idx = modplayer->pattern_idx;
+	snap.line_idx = modplayer->line_idx;
+	snap.tick_idx = modplayer->tick_idx;
+	snap.frames_until_next_tick = modplayer->frames_until_next_tick;
+	snap.speed = modplayer->speed;
+	snap.bpm = modplayer->bpm;
+	snap.do_position_jump = modplayer->do_position_jump ? 1 : 0;
+	snap.position_jump_pat_idx = modplayer->position_jump_pat_idx;
+	snap.position_jump_line_idx = modplayer->position_jump_line_idx;
+	snap.pattern_delay = modplayer->pattern_delay;
+
+	for(unsigned int i=0; i<snap.num_channels; ++i)
+	{
+		// channels playing from the render cache are saved with their real sample position,
+		// so the snapshot doesn't depend on what's in the cache
+		snap.channel_state[i] = modplayer->channel_state[i];
+		if(snap.channel_state[i].cache_entry != 0)
+			render_cache_unbind_channel(modplayer, &snap.channel_state[i]);
+	}
+
+	memcpy(snapshot, &snap, sizeof(mp_snapshot));
+}
+
+bool modplayer_restore(mp_mod_player* modplayer, const void* snapshot)
+{
+	mp_snapshot snap;
+	memcpy(&snap, snapshot, sizeof(mp_snapshot));
+
+	mp_mod* mod = modplayer->mod;
+	if(snap.version != MP_SNAPSHOT_VERSION || snap.num_channels != (unsigned int)mod->num_channels)
+		return false;
+	if(snap.pattern_idx < 0 || snap.pattern_idx >= mod->song_length || snap.line_idx < 0 || snap.line_idx >= 64)
+		return false;
+	if(snap.output_channel_count < 1 || snap.output_channel_count > 2 || snap.output_sample_rate == 0)
+		return false;
+	if(snap.play_state < PLAY_NONE || snap.play_state > PLAY_PATTERN)
+		return false;
+	// the tick timing divides by these
+	if(snap.speed < 1 || snap.bpm < 1 || snap.pattern_delay < 0 || snap.frames_until_next_tick < 0)
+		return false;
+	// the next line only starts when the tick count reaches speed + pattern_delay exactly
+	if(snap.tick_idx < 0 || snap.tick_idx >= snap.speed + snap.pattern_delay)
+		return false;
+	if(snap.do_position_jump)
+	{
+		// a jump past the last pattern loops the song, same as in modplayer_decode_frames_f
+		if(snap.position_jump_pat_idx >= mod->song_length)
+			snap.position_jump_pat_idx = 0;
+		if(snap.position_jump_pat_idx < 0 || snap.position_jump_line_idx < 0 || snap.position_jump_line_idx >= 64)
+			return false;
+	}
+	// the rest of the current tick was counted in frames at the snapshot's rate
+	double frames_until_next_tick = (double)snap.frames_until_next_tick * modplayer->output_sample_rate / snap.output_sample_rate;
+	if(frames_until_next_tick > 2147483647.0)
+		return false;
+	for(unsigned int i=0; i<snap.num_channels; ++i)
+	{
+		mp_channel_state* state = &snap.channel_state[i];
+		if(state->sample >= mod->num_samples)
+			return false;
+		// written as a negated test so NaN fails it too
+		if(!(state->sample_pos >= 0.0f && state->sample_pos <= channel_sample_end(&mod->samples[state->sample], state)))
+			return false;
+
+		// snapshots never refer to the render cache, whatever this one says
+		state->cache_entry = 0;
+		state->cache_frame = 0;
+	}
+
+	modplayer->stereo_width = snap.stereo_width;
+
+	modplayer->play_state = (mp_play_state)snap.play_state;
+	modplayer->pattern_idx = snap.pattern_idx;
+	modplayer->line_idx = snap.line_idx;
+	modplayer->tick_idx = snap.tick_idx;
+	modplayer->frames_until_next_tick = (int)frames_until_next_tick;
+	modplayer->speed = snap.speed;
+	modplayer->bpm = snap.bpm;
+	modplayer->do_position_jump = snap.do_position_jump != 0;
+	modplayer->position_jump_pat_idx = snap.position_jump_pat_idx;
+	modplayer->position_jump_line_idx = snap.position_jump_line_idx;
+	modplayer->pattern_delay = snap.pattern_delay;
+
+	for(unsigned int i=0; i<snap.num_channels; ++i)
+		modplayer->channel_state[i] = snap.channel_state[i];
+
+	return true;
+}
+
 void modplayer_decode_frames_f(mp_mod_player* modplayer, unsigned int frame_count, float* buffer)
 {
 	if(modplayer->play_state == PLAY_NONE)
@@ -5,19 +5,69 @@
 extern "C" {
 #endif
 
+#define XUI_GFX_TILE_SIZE 32     // damage is tracked per tile of this many pixels square
+#define XUI_GFX_MAX_DAMAGE 32    // more damaged rects than this are merged into one
+#define XUI_GFX_MAX_THREADS 16   // most threads xui_gfx_end_frame draws on
+
+typedef struct xui_rect
+{
+    int x;
+    int y;
+    int w;
+    int h;
+} xui_rect;
+
+// a draw call recorded between xui_gfx_begin_frame and xui_gfx_end_frame
+typedef struct xui_gfx_cmd
+{
+    int type;
+    int x, y, w, h;     // for strings: position, and the bounds they cover
+    int col;            // for bitmaps: the key
+    // not part of the command's hash
+    int text;           // offset of the string in the text pool
+    const unsigned int* bitmap;
+} xui_gfx_cmd;
+
 typedef struct xui_gfx
 {
     int width;
     int height;
     unsigned int* pixels;
+
+    // drawing is clipped to this, it covers the whole bitmap outside of xui_gfx_end_frame
+    int clip_x0, clip_y0, clip_x1, clip_y1;
+
+    // damage tracking
+    int recording;
+    xui_gfx_cmd* cmds;
+    int cmd_count;
+    int cmd_capacity;
+    char* text;
+    int text_size;
+    int text_capacity;
+    int tiles_x;
+    int tiles_y;
+    unsigned int* tile_hashes;      // this frame's, followed by last frame's
+    xui_rect damage[XUI_GFX_MAX_DAMAGE];
+    int damage_count;
+
+    // drawing on several threads, see xui_gfx_set_threads
+    int thread_count;
+    xui_rect* bands;                // the damage cut into rows of tiles, one job each
+    struct xui_gfx_pool* pool;
 } xui_gfx;
 
 void xui_init_gfx(xui_gfx* gfx, int width, int height);
 void xui_destroy_gfx(xui_gfx* gfx);
+void xui_gfx_begin_frame(xui_gfx* gfx);
+int xui_gfx_end_frame(xui_gfx* gfx);
+void xui_gfx_set_threads(xui_gfx* gfx, int thread_count);
 void xui_clear(xui_gfx* gfx, int col);
 void xui_draw_rect(xui_gfx* gfx, int x, int y, int w, int h, int col);
+void xui_draw_rect_blend(xui_gfx* gfx, int x, int y, int w, int h, int col);
 void xui_draw_rect_outline(xui_gfx* gfx, int x, int y, int w, int h, int col);
 void xui_draw_string(xui_gfx* gfx, int x, int y, int col, const char* str);
+void xui_draw_bitmap(xui_gfx* gfx, int x, int y, int w, int h, const unsigned int* pixels, unsigned int key);
 void xui_string_bounds(xui_gfx* gfx, const char* str, int* w, int* h);
 
 #ifdef __cplusplus
@@ -28,6 +78,45 @@ void xui_string_bounds(xui_gfx* gfx, const char* str, int* w, int* h);
 
 #ifdef XUI_GFX_IMPLEMENTATION
 
+// fills use the widest vectors the compiler is allowed to emit, build with -mavx2 to get 32 byte stores
+#if defined(__AVX2__)
+#include <stdint.h>
+#include <immintrin.h>
+#define XUI_GFX_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <stdint.h>
+#include <emmintrin.h>
+#define XUI_GFX_SSE2
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION xui_gfx_mutex;
+typedef CONDITION_VARIABLE xui_gfx_cond;
+typedef HANDLE xui_gfx_thread;
+#define xui_gfx_mutex_init(m) InitializeCriticalSection(m)
+#define xui_gfx_mutex_term(m) DeleteCriticalSection(m)
+#define xui_gfx_lock(m) EnterCriticalSection(m)
+#define xui_gfx_unlock(m) LeaveCriticalSection(m)
+#define xui_gfx_cond_init(c) InitializeConditionVariable(c)
+#define xui_gfx_cond_term(c) ((void)(c))
+#define xui_gfx_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define xui_gfx_wake_all(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t xui_gfx_mutex;
+typedef pthread_cond_t xui_gfx_cond;
+typedef pthread_t xui_gfx_thread;
+#define xui_gfx_mutex_init(m) pthread_mutex_init(m, NULL)
+#define xui_gfx_mutex_term(m) pthread_mutex_destroy(m)
+#define xui_gfx_lock(m) pthread_mutex_lock(m)
+#define xui_gfx_unlock(m) pthread_mutex_unlock(m)
+#define xui_gfx_cond_init(c) pthread_cond_init(c, NULL)
+#define xui_gfx_cond_term(c) pthread_cond_destroy(c)
+#define xui_gfx_wait(c, m) pthread_cond_wait(c, m)
+#define xui_gfx_wake_all(c) pthread_cond_broadcast(c)
+#endif
+
 unsigned char font_data_8x8[95][8] = {
 {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
 {0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18, 0x00},
@@ -332,53 +421,597 @@ static inline int mmax(int a, int b)
 	return a > b ? a : b;
 }
 
+enum
+{
+    XUI_GFX_CMD_CLEAR,
+    XUI_GFX_CMD_RECT,
+    XUI_GFX_CMD_RECT_BLEND,
+    XUI_GFX_CMD_RECT_OUTLINE,
+    XUI_GFX_CMD_STRING,
+    XUI_GFX_CMD_BITMAP,
+};
+
+#define XUI_GLYPH_W 6
+#define XUI_GLYPH_H 8
+
+// font_data_6x8 expanded to one mask word per pixel, 8 to a row so a row is a single vector.
+// built by xui_init_gfx.
+static unsigned int xui_glyph_masks[95][XUI_GLYPH_H][8];
+static int xui_glyph_masks_ready = 0;
+
+static void xui_gfx_init_glyphs(void)
+{
+    if(xui_glyph_masks_ready)
+        return;
+
+    for(int g=0; g<95; ++g)
+        for(int j=0; j<XUI_GLYPH_H; ++j)
+            for(int i=0; i<8; ++i)
+                xui_glyph_masks[g][j][i] = (i < XUI_GLYPH_W && ((font_data_6x8[g][j] >> (XUI_GLYPH_W-i)) & 0x1)) ? 0xffffffff : 0;
+    xui_glyph_masks_ready = 1;
+}
+
 void xui_init_gfx(xui_gfx* gfx, int width, int height)
 {
+    memset(gfx, 0x00, sizeof(xui_gfx));
     gfx->width = width;
     gfx->height = height;
     gfx->pixels = (unsigned int*)malloc(width * height * sizeof(unsigned int));
     memset(gfx->pixels, 0x00, width * height * sizeof(unsigned int ));
+    gfx->clip_x1 = width;
+    gfx->clip_y1 = height;
+    xui_gfx_init_glyphs();
+
+    gfx->tiles_x = (width + XUI_GFX_TILE_SIZE - 1) / XUI_GFX_TILE_SIZE;
+    gfx->tiles_y = (height + XUI_GFX_TILE_SIZE - 1) / XUI_GFX_TILE_SIZE;
+    gfx->tile_hashes = (unsigned int*)malloc(2 * gfx->tiles_x * gfx->tiles_y * sizeof(unsigned int));
+    // a hash never ends up 0, so the first frame is damaged everywhere
+    memset(gfx->tile_hashes, 0x00, 2 * gfx->tiles_x * gfx->tiles_y * sizeof(unsigned int));
+    // damaged rects never overlap (see xui_gfx_add_damage), so they can't be cut into more bands than there are tiles
+    gfx->bands = (xui_rect*)malloc(gfx->tiles_x * gfx->tiles_y * sizeof(xui_rect));
+    gfx->thread_count = 1;
 }
 
 void xui_destroy_gfx(xui_gfx* gfx)
 {
+    xui_gfx_set_threads(gfx, 1);
+    free(gfx->bands);
+    gfx->bands = NULL;
     free(gfx->pixels);
     gfx->pixels = NULL;
+    free(gfx->cmds);
+    gfx->cmds = NULL;
+    free(gfx->text);
+    gfx->text = NULL;
+    free(gfx->tile_hashes);
+    gfx->tile_hashes = NULL;
+}
+
+static void xui_gfx_record(xui_gfx* gfx, int type, int x, int y, int w, int h, int col, const char* str)
+{
+    if(gfx->cmd_count == gfx->cmd_capacity)
+    {
+        gfx->cmd_capacity = gfx->cmd_capacity ? gfx->cmd_capacity * 2 : 256;
+        gfx->cmds = (xui_gfx_cmd*)realloc(gfx->cmds, gfx->cmd_capacity * sizeof(xui_gfx_cmd));
+    }
+
+    xui_gfx_cmd* cmd = &gfx->cmds[gfx->cmd_count++];
+    cmd->type = type;
+    cmd->x = x;
+    cmd->y = y;
+    cmd->w = w;
+    cmd->h = h;
+    cmd->col = col;
+    cmd->text = -1;
+    cmd->bitmap = NULL;
+    if(str)
+    {
+        int size = (int)strlen(str) + 1;
+        if(gfx->text_size + size > gfx->text_capacity)
+        {
+            gfx->text_capacity = mmax(gfx->text_capacity * 2, gfx->text_size + size + 4096);
+            gfx->text = (char*)realloc(gfx->text, gfx->text_capacity);
+        }
+        memcpy(gfx->text + gfx->text_size, str, size);
+        cmd->text = gfx->text_size;
+        gfx->text_size += size;
+    }
+}
+
+// after this, draw calls are only recorded. xui_gfx_end_frame works out which parts of the bitmap
+// they change compared to the previous frame, and only draws those.
+void xui_gfx_begin_frame(xui_gfx* gfx)
+{
+    gfx->cmd_count = 0;
+    gfx->text_size = 0;
+    gfx->recording = 1;
+}
+
+static unsigned int xui_gfx_hash(unsigned int hash, const void* data, int size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(int i=0; i<size; ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static int xui_rects_overlap(const xui_rect* a, const xui_rect* b)
+{
+    return a->x < b->x + b->w && b->x < a->x + a->w && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+// grows a to cover b as well
+static void xui_rect_union(xui_rect* a, const xui_rect* b)
+{
+    int x0 = mmin(a->x, b->x);
+    int y0 = mmin(a->y, b->y);
+    int x1 = mmax(a->x + a->w, b->x + b->w);
+    int y1 = mmax(a->y + a->h, b->y + b->h);
+    a->x = x0;
+    a->y = y0;
+    a->w = x1 - x0;
+    a->h = y1 - y0;
+}
+
+// folds any rects that damage[i] overlaps into it. damaged rects are drawn as separate bands, possibly on several
+// threads at once, so they must never overlap, but a rect that has grown (or been merged from all the others) can
+// reach into runs added after it.
+static void xui_gfx_absorb_damage(xui_gfx* gfx, int i)
+{
+    for(int j=0; j<gfx->damage_count; )
+    {
+        if(j != i && xui_rects_overlap(&gfx->damage[i], &gfx->damage[j]))
+        {
+            xui_rect_union(&gfx->damage[i], &gfx->damage[j]);
+            int last = --gfx->damage_count;
+            gfx->damage[j] = gfx->damage[last];
+            if(i == last)
+                i = j;
+            // the grown rect may reach rects that were already checked
+            j = 0;
+        }
+        else
+        {
+            ++j;
+        }
+    }
+}
+
+static void xui_gfx_add_damage(xui_gfx* gfx, int x, int y, int w, int h)
+{
+    xui_rect run = { x, y, w, h };
+
+    // grow a rect from the tile row above if it spans the same columns
+    for(int i=0; i<gfx->damage_count; ++i)
+    {
+        xui_rect* r = &gfx->damage[i];
+        if(r->x == x && r->w == w && r->y + r->h == y)
+        {
+            r->h += h;
+            xui_gfx_absorb_damage(gfx, i);
+            return;
+        }
+    }
+
+    // a run that's already partly covered goes into the rect covering it
+    for(int i=0; i<gfx->damage_count; ++i)
+    {
+        if(xui_rects_overlap(&gfx->damage[i], &run))
+        {
+            xui_rect_union(&gfx->damage[i], &run);
+            xui_gfx_absorb_damage(gfx, i);
+            return;
+        }
+    }
+
+    if(gfx->damage_count == XUI_GFX_MAX_DAMAGE)
+    {
+        for(int i=1; i<gfx->damage_count; ++i)
+            xui_rect_union(&gfx->damage[0], &gfx->damage[i]);
+        xui_rect_union(&gfx->damage[0], &run);
+        gfx->damage_count = 1;
+        return;
+    }
+
+    gfx->damage[gfx->damage_count++] = run;
+}
+
+// draws the recorded commands into r. the draw functions only read the bitmap and the clip rect from gfx, so each
+// call draws through its own copy, and calls for rects that don't overlap can run at the same time.
+static void xui_gfx_replay(const xui_gfx* gfx, const xui_rect* r)
+{
+    xui_gfx target = *gfx;
+    target.clip_x0 = r->x;
+    target.clip_y0 = r->y;
+    target.clip_x1 = r->x + r->w;
+    target.clip_y1 = r->y + r->h;
+    for(int c=0; c<gfx->cmd_count; ++c)
+    {
+        xui_gfx_cmd* cmd = &gfx->cmds[c];
+        if(cmd->x >= target.clip_x1 || cmd->y >= target.clip_y1 || cmd->x + cmd->w <= target.clip_x0 || cmd->y + cmd->h <= target.clip_y0)
+            continue;
+
+        switch(cmd->type)
+        {
+            case XUI_GFX_CMD_CLEAR: xui_clear(&target, cmd->col); break;
+            case XUI_GFX_CMD_RECT: xui_draw_rect(&target, cmd->x, cmd->y, cmd->w, cmd->h, cmd->col); break;
+            case XUI_GFX_CMD_RECT_BLEND: xui_draw_rect_blend(&target, cmd->x, cmd->y, cmd->w, cmd->h, cmd->col); break;
+            case XUI_GFX_CMD_RECT_OUTLINE: xui_draw_rect_outline(&target, cmd->x, cmd->y, cmd->w, cmd->h, cmd->col); break;
+            case XUI_GFX_CMD_STRING: xui_draw_string(&target, cmd->x, cmd->y, cmd->col, gfx->text + cmd->text); break;
+            case XUI_GFX_CMD_BITMAP: xui_draw_bitmap(&target, cmd->x, cmd->y, cmd->w, cmd->h, cmd->bitmap, (unsigned int)cmd->col); break;
+        }
+    }
+}
+
+// workers that replay bands of the frame alongside the thread calling xui_gfx_end_frame. every band is a separate
+// part of the bitmap, and is drawn by one thread in command order, so the result is the same whoever draws it.
+typedef struct xui_gfx_pool
+{
+    xui_gfx* gfx;
+    xui_gfx_mutex lock;
+    xui_gfx_cond work_ready;
+    xui_gfx_cond work_done;
+    int band_count;
+    int next_band;
+    int bands_done;
+    int quit;
+    int worker_count;
+    xui_gfx_thread workers[XUI_GFX_MAX_THREADS - 1];
+} xui_gfx_pool;
+
+// takes bands until there are none left. called with the lock held, returns with it held
+static void xui_gfx_pool_draw(xui_gfx_pool* pool)
+{
+    while(pool->next_band < pool->band_count)
+    {
+        int band = pool->next_band++;
+        xui_gfx_unlock(&pool->lock);
+        xui_gfx_replay(pool->gfx, &pool->gfx->bands[band]);
+        xui_gfx_lock(&pool->lock);
+        if(++pool->bands_done == pool->band_count)
+            xui_gfx_wake_all(&pool->work_done);
+    }
+}
+
+static void xui_gfx_pool_worker(xui_gfx_pool* pool)
+{
+    xui_gfx_lock(&pool->lock);
+    while(!pool->quit)
+    {
+        xui_gfx_pool_draw(pool);
+        xui_gfx_wait(&pool->work_ready, &pool->lock);
+    }
+    xui_gfx_unlock(&pool->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI xui_gfx_pool_thread_proc(LPVOID user_data)
+{
+    xui_gfx_pool_worker((xui_gfx_pool*)user_data);
+    return 0;
+}
+#else
+static void* xui_gfx_pool_thread_proc(void* user_data)
+{
+    xui_gfx_pool_worker((xui_gfx_pool*)user_data);
+    return NULL;
+}
+#endif
+
+static void xui_gfx_run_bands(xui_gfx* gfx, int band_count)
+{
+    xui_gfx_pool* pool = gfx->pool;
+    xui_gfx_lock(&pool->lock);
+    pool->band_count = band_count;
+    pool->next_band = 0;
+    pool->bands_done = 0;
+    xui_gfx_wake_all(&pool->work_ready);
+    xui_gfx_pool_draw(pool);
+    while(pool->bands_done < pool->band_count)
+        xui_gfx_wait(&pool->work_done, &pool->lock);
+    xui_gfx_unlock(&pool->lock);
+}
+
+// draws each frame on thread_count threads, counting the one calling xui_gfx_end_frame. 1 (the default) draws
+// without any threads. it only pays off for big bitmaps, where there's a lot of damage to share out.
+void xui_gfx_set_threads(xui_gfx* gfx, int thread_count)
+{
+    thread_count = mmax(1, mmin(thread_count, XUI_GFX_MAX_THREADS));
+    if(thread_count == gfx->thread_count)
+        return;
+
+    xui_gfx_pool* pool = gfx->pool;
+    if(pool)
+    {
+        xui_gfx_lock(&pool->lock);
+        pool->quit = 1;
+        xui_gfx_wake_all(&pool->work_ready);
+        xui_gfx_unlock(&pool->lock);
+        for(int i=0; i<pool->worker_count; ++i)
+        {
+#ifdef _WIN32
+            WaitForSingleObject(pool->workers[i], INFINITE);
+            CloseHandle(pool->workers[i]);
+#else
+            pthread_join(pool->workers[i], NULL);
+#endif
+        }
+        xui_gfx_cond_term(&pool->work_done);
+        xui_gfx_cond_term(&pool->work_ready);
+        xui_gfx_mutex_term(&pool->lock);
+        free(pool);
+        gfx->pool = NULL;
+    }
+
+    gfx->thread_count = 1;
+    if(thread_count == 1)
+        return;
+
+    pool = (xui_gfx_pool*)malloc(sizeof(xui_gfx_pool));
+    memset(pool, 0x00, sizeof(xui_gfx_pool));
+    pool->gfx = gfx;
+    xui_gfx_mutex_init(&pool->lock);
+    xui_gfx_cond_init(&pool->work_ready);
+    xui_gfx_cond_init(&pool->work_done);
+    for(int i=0; i<thread_count - 1; ++i)
+    {
+#ifdef _WIN32
+        pool->workers[i] = CreateThread(NULL, 0, xui_gfx_pool_thread_proc, pool, 0, NULL);
+        if(pool->workers[i] == NULL)
+            break;
+#else
+        if(pthread_create(&pool->workers[i], NULL, xui_gfx_pool_thread_proc, pool) != 0)
+            break;
+#endif
+        pool->worker_count++;
+    }
+    gfx->pool = pool;
+    gfx->thread_count = pool->worker_count + 1;
+
+    // couldn't start any workers, so go without
+    if(pool->worker_count == 0)
+    {
+        gfx->thread_count = 2;
+        xui_gfx_set_threads(gfx, 1);
+    }
+}
+
+// draws what changed since the last frame, and leaves the changed rects in gfx->damage for presenting.
+// returns how many there are, 0 when the bitmap is the same as last frame.
+int xui_gfx_end_frame(xui_gfx* gfx)
+{
+    gfx->recording = 0;
+    gfx->damage_count = 0;
+
+    // each tile gets a hash of every command that touches it, in order
+    int tile_count = gfx->tiles_x * gfx->tiles_y;
+    unsigned int* hashes = gfx->tile_hashes;
+    unsigned int* prev_hashes = gfx->tile_hashes + tile_count;
+    for(int i=0; i<tile_count; ++i)
+        hashes[i] = 2166136261u;
+
+    for(int c=0; c<gfx->cmd_count; ++c)
+    {
+        xui_gfx_cmd* cmd = &gfx->cmds[c];
+        int tx0 = mmax(0, cmd->x) / XUI_GFX_TILE_SIZE;
+        int ty0 = mmax(0, cmd->y) / XUI_GFX_TILE_SIZE;
+        int tx1 = mmin(cmd->x + cmd->w, gfx->width);
+        int ty1 = mmin(cmd->y + cmd->h, gfx->height);
+        if(tx1 <= 0 || ty1 <= 0 || cmd->x >= gfx->width || cmd->y >= gfx->height)
+            continue;
+        tx1 = (tx1 + XUI_GFX_TILE_SIZE - 1) / XUI_GFX_TILE_SIZE;
+        ty1 = (ty1 + XUI_GFX_TILE_SIZE - 1) / XUI_GFX_TILE_SIZE;
+
+        unsigned int cmd_hash = xui_gfx_hash(2166136261u, cmd, (int)((char*)&cmd->text - (char*)cmd));
+        if(cmd->text >= 0)
+            cmd_hash = xui_gfx_hash(cmd_hash, gfx->text + cmd->text, (int)strlen(gfx->text + cmd->text));
+
+        for(int ty=ty0; ty<ty1; ++ty)
+        {
+            for(int tx=tx0; tx<tx1; ++tx)
+            {
+                unsigned int* hash = &hashes[ty * gfx->tiles_x + tx];
+                *hash = ((*hash ^ cmd_hash) * 16777619u) | 1;
+            }
+        }
+    }
+
+    // runs of changed tiles in each row become damaged rects
+    for(int ty=0; ty<gfx->tiles_y; ++ty)
+    {
+        int run_start = -1;
+        for(int tx=0; tx<=gfx->tiles_x; ++tx)
+        {
+            int changed = tx < gfx->tiles_x && hashes[ty * gfx->tiles_x + tx] != prev_hashes[ty * gfx->tiles_x + tx];
+            if(changed && run_start < 0)
+            {
+                run_start = tx;
+            }
+            else if(!changed && run_start >= 0)
+            {
+                int x = run_start * XUI_GFX_TILE_SIZE;
+                int y = ty * XUI_GFX_TILE_SIZE;
+                xui_gfx_add_damage(gfx, x, y, mmin(tx * XUI_GFX_TILE_SIZE, gfx->width) - x,
+                    mmin(y + XUI_GFX_TILE_SIZE, gfx->height) - y);
+                run_start = -1;
+            }
+        }
+    }
+
+    // replay the commands a row of tiles at a time, which keeps what's being drawn in the cache, and lets the
+    // rows be shared out when there are threads to draw on
+    int band_count = 0;
+    for(int i=0; i<gfx->damage_count; ++i)
+    {
+        xui_rect* r = &gfx->damage[i];
+        for(int y=r->y; y<r->y + r->h; y+=XUI_GFX_TILE_SIZE)
+        {
+            xui_rect* band = &gfx->bands[band_count++];
+            band->x = r->x;
+            band->y = y;
+            band->w = r->w;
+            band->h = mmin(XUI_GFX_TILE_SIZE, r->y + r->h - y);
+        }
+    }
+    if(gfx->thread_count > 1 && band_count > 1)
+    {
+        xui_gfx_run_bands(gfx, band_count);
+    }
+    else
+    {
+        for(int i=0; i<band_count; ++i)
+            xui_gfx_replay(gfx, &gfx->bands[i]);
+    }
+
+    memcpy(prev_hashes, hashes, tile_count * sizeof(unsigned int));
+
+    return gfx->damage_count;
+}
+
+// fills count pixels with col: single pixels up to an aligned address, then whole vectors, then the rest
+static void xui_gfx_fill_span(unsigned int* pix, int count, unsigned int col)
+{
+#if defined(XUI_GFX_AVX2)
+    for(; count > 0 && ((uintptr_t)pix & 31) != 0; --count)
+        *pix++ = col;
+    __m256i col8 = _mm256_set1_epi32((int)col);
+    for(; count >= 32; count -= 32, pix += 32)
+    {
+        _mm256_store_si256((__m256i*)pix, col8);
+        _mm256_store_si256((__m256i*)(pix + 8), col8);
+        _mm256_store_si256((__m256i*)(pix + 16), col8);
+        _mm256_store_si256((__m256i*)(pix + 24), col8);
+    }
+    for(; count >= 8; count -= 8, pix += 8)
+        _mm256_store_si256((__m256i*)pix, col8);
+#elif defined(XUI_GFX_SSE2)
+    for(; count > 0 && ((uintptr_t)pix & 15) != 0; --count)
+        *pix++ = col;
+    __m128i col4 = _mm_set1_epi32((int)col);
+    for(; count >= 16; count -= 16, pix += 16)
+    {
+        _mm_store_si128((__m128i*)pix, col4);
+        _mm_store_si128((__m128i*)(pix + 4), col4);
+        _mm_store_si128((__m128i*)(pix + 8), col4);
+        _mm_store_si128((__m128i*)(pix + 12), col4);
+    }
+    for(; count >= 4; count -= 4, pix += 4)
+        _mm_store_si128((__m128i*)pix, col4);
+#endif
+    for(; count > 0; --count)
+        *pix++ = col;
+}
+
+// blends count pixels towards col by alpha (0-256), the result is opaque
+static void xui_gfx_blend_span(unsigned int* pix, int count, unsigned int col, unsigned int alpha)
+{
+    unsigned int inv_alpha = 256 - alpha;
+    unsigned int rb = (col & 0x00ff00ff) * alpha;
+    unsigned int g = (col & 0x0000ff00) * alpha;
+#if defined(XUI_GFX_SSE2) || defined(XUI_GFX_AVX2)
+    // four pixels at a time, each channel widened to 16 bits
+    __m128i zero = _mm_setzero_si128();
+    __m128i src = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)col), zero), _mm_set1_epi16((short)alpha));
+    __m128i inv = _mm_set1_epi16((short)inv_alpha);
+    __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    for(; count >= 4; count -= 4, pix += 4)
+    {
+        __m128i dst = _mm_loadu_si128((__m128i*)pix);
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), inv), src);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), inv), src);
+        dst = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        _mm_storeu_si128((__m128i*)pix, _mm_or_si128(dst, opaque));
+    }
+#endif
+    for(; count > 0; --count, ++pix)
+    {
+        unsigned int dst = *pix;
+        unsigned int dst_rb = ((dst & 0x00ff00ff) * inv_alpha + rb) >> 8;
+        unsigned int dst_g = ((dst & 0x0000ff00) * inv_alpha + g) >> 8;
+        *pix = 0xff000000 | (dst_rb & 0x00ff00ff) | (dst_g & 0x0000ff00);
+    }
 }
 
 void xui_clear(xui_gfx* gfx, int col)
 {
-    for(int i=0; i < (gfx->width * gfx->height); ++i)
-        gfx->pixels[i] = col;
+    if(gfx->recording)
+    {
+        xui_gfx_record(gfx, XUI_GFX_CMD_CLEAR, 0, 0, gfx->width, gfx->height, col, NULL);
+        return;
+    }
+
+    xui_draw_rect(gfx, 0, 0, gfx->width, gfx->height, col);
 }
 
 void xui_draw_rect(xui_gfx* gfx, int x, int y, int w, int h, int col)
 {
-	int x0 = mmax(0, x);
-	int y0 = mmax(0, y);
-	int x1 = mmin(x + w, gfx->width);
-	int y1 = mmin(y + h, gfx->height);
+    if(gfx->recording)
+    {
+        xui_gfx_record(gfx, XUI_GFX_CMD_RECT, x, y, w, h, col, NULL);
+        return;
+    }
 
-	for(int j=y0; j < y1; ++j)
+	int x0 = mmax(gfx->clip_x0, x);
+	int y0 = mmax(gfx->clip_y0, y);
+	int x1 = mmin(x + w, gfx->clip_x1);
+	int y1 = mmin(y + h, gfx->clip_y1);
+	if(x0 >= x1 || y0 >= y1)
+		return;
+
+	// rows spanning the whole bitmap are one contiguous span
+	if(x0 == 0 && x1 == gfx->width)
 	{
-        unsigned int* pix = &gfx->pixels[j * gfx->width + x0];
-		for(int i=x0; i < x1; ++i)
-		{
-			*pix++ = col;
-		}
+		xui_gfx_fill_span(&gfx->pixels[y0 * gfx->width], (y1 - y0) * gfx->width, (unsigned int)col);
+		return;
 	}
+
+	for(int j=y0; j < y1; ++j)
+		xui_gfx_fill_span(&gfx->pixels[j * gfx->width + x0], x1 - x0, (unsigned int)col);
+}
+
+// like xui_draw_rect, but mixes col into what's already there by its alpha, for translucent overlays
+void xui_draw_rect_blend(xui_gfx* gfx, int x, int y, int w, int h, int col)
+{
+    if(gfx->recording)
+    {
+        xui_gfx_record(gfx, XUI_GFX_CMD_RECT_BLEND, x, y, w, h, col, NULL);
+        return;
+    }
+
+    unsigned int alpha = ((unsigned int)col >> 24);
+    if(alpha == 0xff)
+    {
+        xui_draw_rect(gfx, x, y, w, h, col);
+        return;
+    }
+    alpha += alpha >> 7;    // 0-255 to 0-256
+
+	int x0 = mmax(gfx->clip_x0, x);
+	int y0 = mmax(gfx->clip_y0, y);
+	int x1 = mmin(x + w, gfx->clip_x1);
+	int y1 = mmin(y + h, gfx->clip_y1);
+	if(alpha == 0 || x0 >= x1)
+		return;
+
+	for(int j=y0; j < y1; ++j)
+		xui_gfx_blend_span(&gfx->pixels[j * gfx->width + x0], x1 - x0, (unsigned int)col, alpha);
 }
 
 void xui_draw_rect_outline(xui_gfx* gfx, int x, int y, int w, int h, int col)
 {
-	int x0 = mmax(0, x);
-	int y0 = mmax(0, y);
-	int x1 = mmin(x + w, gfx->width);
-	int y1 = mmin(y + h, gfx->height);
+    if(gfx->recording)
+    {
+        xui_gfx_record(gfx, XUI_GFX_CMD_RECT_OUTLINE, x, y, w, h, col, NULL);
+        return;
+    }
+
+	int x0 = mmax(gfx->clip_x0, x);
+	int y0 = mmax(gfx->clip_y0, y);
+	int x1 = mmin(x + w, gfx->clip_x1);
+	int y1 = mmin(y + h, gfx->clip_y1);
 
     int gfx_width = gfx->width;
-    int gfx_height = gfx->height;
-	if(x >= 0 && x < gfx_width)
+	if(x >= gfx->clip_x0 && x < gfx->clip_x1)
 	{
         unsigned int* pix = &gfx->pixels[y0 * gfx_width + x];
 		for(int j=y0; j < y1; ++j)
@@ -387,7 +1020,7 @@ void xui_draw_rect_outline(xui_gfx* gfx, int x, int y, int w, int h, int col)
             pix += gfx_width;
         }
 	}
-	if(x+w-1 >= 0 && x+w-1 < gfx_width)
+	if(x+w-1 >= gfx->clip_x0 && x+w-1 < gfx->clip_x1)
 	{
         unsigned int* pix = &gfx->pixels[y0 * gfx_width + x+w-1];
 		for(int j=y0; j < y1; ++j)
@@ -396,18 +1029,40 @@ void xui_draw_rect_outline(xui_gfx* gfx, int x, int y, int w, int h, int col)
             pix += gfx_width;
         }
 	}
-	if(y >= 0 && y < gfx_height)
-	{
-        unsigned int* pix = &gfx->pixels[y * gfx_width + x0];
-		for(int i=x0; i < x1; ++i)
-			*pix++ = col;
-	}
-	if(y+h-1 >= 0 && y+h-1 < gfx_height)
-	{
-        unsigned int* pix = &gfx->pixels[(y+h-1) * gfx_width + x0];
-		for(int i=x0; i < x1; ++i)
-			*pix++ = col;
-	}
+	if(y >= gfx->clip_y0 && y < gfx->clip_y1 && x0 < x1)
+		xui_gfx_fill_span(&gfx->pixels[y * gfx_width + x0], x1 - x0, (unsigned int)col);
+	if(y+h-1 >= gfx->clip_y0 && y+h-1 < gfx->clip_y1 && x0 < x1)
+		xui_gfx_fill_span(&gfx->pixels[(y+h-1) * gfx_width + x0], x1 - x0, (unsigned int)col);
+}
+
+// rows j0 to j1 of a glyph that is entirely inside the clip rect horizontally
+static void xui_gfx_blit_glyph(xui_gfx* gfx, int x, int y, int j0, int j1, unsigned int col, int glyph)
+{
+    unsigned int* pix = &gfx->pixels[(y+j0)*gfx->width + x];
+#if defined(XUI_GFX_AVX2)
+    __m256i col8 = _mm256_set1_epi32((int)col);
+    for(int j=j0; j<j1; ++j, pix += gfx->width)
+        _mm256_maskstore_epi32((int*)pix, _mm256_loadu_si256((__m256i const*)xui_glyph_masks[glyph][j]), col8);
+#elif defined(XUI_GFX_SSE2)
+    // the first four pixels, then the last two, so nothing outside the glyph is touched
+    __m128i col4 = _mm_set1_epi32((int)col);
+    for(int j=j0; j<j1; ++j, pix += gfx->width)
+    {
+        __m128i mask = _mm_loadu_si128((__m128i const*)xui_glyph_masks[glyph][j]);
+        __m128i dst = _mm_loadu_si128((__m128i const*)pix);
+        _mm_storeu_si128((__m128i*)pix, _mm_or_si128(_mm_andnot_si128(mask, dst), _mm_and_si128(mask, col4)));
+        mask = _mm_loadl_epi64((__m128i const*)&xui_glyph_masks[glyph][j][4]);
+        dst = _mm_loadl_epi64((__m128i const*)(pix + 4));
+        _mm_storel_epi64((__m128i*)(pix + 4), _mm_or_si128(_mm_andnot_si128(mask, dst), _mm_and_si128(mask, col4)));
+    }
+#else
+    for(int j=j0; j<j1; ++j, pix += gfx->width)
+    {
+        unsigned int const* mask = xui_glyph_masks[glyph][j];
+        for(int i=0; i<XUI_GLYPH_W; ++i)
+            pix[i] = (pix[i] & ~mask[i]) | (col & mask[i]);
+    }
+#endif
 }
 
 void xui_draw_char(xui_gfx* gfx, int x, int y, int col, char ch)
@@ -415,42 +1070,67 @@ void xui_draw_char(xui_gfx* gfx, int x, int y, int col, char ch)
 	if(ch < 32 || ch > 126)
 		return;
 
-	int font_h = 8;
-	int font_w = 6;
-	unsigned char* letter = font_data_6x8[ch - 32];
-	for(int j=0; j<mmin(font_h, gfx->height - y); ++j)
+	int j0 = mmax(0, gfx->clip_y0 - y);
+	int j1 = mmin(XUI_GLYPH_H, gfx->clip_y1 - y);
+	int i0 = mmax(0, gfx->clip_x0 - x);
+	int i1 = mmin(XUI_GLYPH_W, gfx->clip_x1 - x);
+	if(j0 >= j1 || i0 >= i1)
+		return;
+
+	if(i0 == 0 && i1 == XUI_GLYPH_W)
 	{
-		unsigned char c = letter[j];
-		for(int i=0; i<mmin(font_w, gfx->width - x); ++i)
-		{
-			if(((c >> (font_w-i)) & 0x1) != 0)
-			{
-				gfx->pixels[(y+j)*gfx->width + (i+x)] = col;
-			}
-		}
+		xui_gfx_blit_glyph(gfx, x, y, j0, j1, (unsigned int)col, ch - 32);
+		return;
 	}
-/*	int font_h = 13;
-	int font_w = 8;
-	unsigned char* letter = letter_data[ch - 32];
-	for(int j=0; j<mmin(13, gfx->height - y); ++j)
+
+	// cut off at the sides
+	for(int j=j0; j<j1; ++j)
 	{
-		unsigned char c = letter[12 - j];
-		for(int i=0; i<mmin(8, gfx->width - x); ++i)
-		{
-			if(((c >> (7-i)) & 0x1) != 0)
-			{
-				gfx->pixels[(y+j)*gfx->width + (i+x)] = col;
-			}
-		}
-	}*/
+		unsigned int const* mask = xui_glyph_masks[ch - 32][j];
+		unsigned int* pix = &gfx->pixels[(y+j)*gfx->width + x];
+		for(int i=i0; i<i1; ++i)
+			pix[i] = (pix[i] & ~mask[i]) | (col & mask[i]);
+	}
 }
 
 void xui_draw_string(xui_gfx* gfx, int x, int y, int col, const char* str)
 {
+    if(gfx->recording)
+    {
+        int w, h;
+        xui_string_bounds(gfx, str, &w, &h);
+        xui_gfx_record(gfx, XUI_GFX_CMD_STRING, x, y, w, h, col, str);
+        return;
+    }
+
 	int ch_width = 8;
 	int ch_space = 2;
 	int line_height = 10;
 
+	// clip once for the whole string when it fits, which is nearly always
+	int w, h;
+	xui_string_bounds(gfx, str, &w, &h);
+	if(x >= gfx->clip_x0 && y >= gfx->clip_y0 && x + w <= gfx->clip_x1 && y + h <= gfx->clip_y1)
+	{
+		int x0 = x;
+		char ch;
+		while((ch = *str++))
+		{
+			if(ch >= 32 && ch <= 126)
+				xui_gfx_blit_glyph(gfx, x, y, 0, XUI_GLYPH_H, (unsigned int)col, ch - 32);
+			x += ch_width + ch_space;
+
+			if(ch == '\n')
+			{
+				y += line_height;
+				x = x0;
+			}
+		}
+		return;
+	}
+	if(x >= gfx->clip_x1 || y >= gfx->clip_y1 || x + w <= gfx->clip_x0 || y + h <= gfx->clip_y0)
+		return;
+
 	int x0 = x;
 	char ch;
 	while((ch = *str++))
@@ -466,6 +1146,28 @@ void xui_draw_string(xui_gfx* gfx, int x, int y, int col, const char* str)
 	}
 }
 
+// copies a w by h block of opaque pixels. damage tracking only sees key, so it must be different whenever
+// the pixels are, and the pixels must stay as they are until xui_gfx_end_frame.
+void xui_draw_bitmap(xui_gfx* gfx, int x, int y, int w, int h, const unsigned int* pixels, unsigned int key)
+{
+    if(gfx->recording)
+    {
+        xui_gfx_record(gfx, XUI_GFX_CMD_BITMAP, x, y, w, h, (int)key, NULL);
+        gfx->cmds[gfx->cmd_count - 1].bitmap = pixels;
+        return;
+    }
+
+	int x0 = mmax(gfx->clip_x0, x);
+	int y0 = mmax(gfx->clip_y0, y);
+	int x1 = mmin(x + w, gfx->clip_x1);
+	int y1 = mmin(y + h, gfx->clip_y1);
+	if(x0 >= x1)
+		return;
+
+	for(int j=y0; j < y1; ++j)
+		memcpy(&gfx->pixels[j * gfx->width + x0], &pixels[(j - y) * w + (x0 - x)], (x1 - x0) * sizeof(unsigned int));
+}
+
 void xui_string_bounds(xui_gfx* gfx, const char* str, int* w, int* h)
 {
 	int ch_width = 8;